@@ -18,14 +18,87 @@ auto factory = [](auto sequence, auto...args) {
 };
 }
 #include <memory>
+#include <atomic>
+#include <cstdlib>
 namespace conduit {
+struct frame_pool_stats {
+  std::size_t nb_allocated = 0; // frames obtained from malloc
+  std::size_t nb_reused = 0;    // frames recycled from the pool
+};
+// frame_pool : thread local free lists of coroutine frames, one per size class
+// (multiples of 64 bytes, up to 2KB). Bigger frames go directly to malloc.
+// A frame released by another thread goes to the pool of this thread.
+class frame_pool {
+public:
+  static constexpr std::size_t granularity = 64;
+  static constexpr std::size_t nb_size_classes = 32;
+  static frame_pool& local() {
+    thread_local frame_pool pool;
+    return pool;
+  }
+  void* alloc(std::size_t n) {
+    std::size_t size_class = (n + granularity - 1) / granularity;
+    if (size_class < nb_size_classes && free_lists_[size_class] != nullptr) {
+      free_frame* frame = free_lists_[size_class];
+      free_lists_[size_class] = frame->next;
+      ++stats_.nb_reused;
+      return frame;
+    }
+    ++stats_.nb_allocated;
+    return std::malloc(size_class < nb_size_classes ? size_class * granularity : n);
+  }
+  void dealloc(void* p, std::size_t n) {
+    std::size_t size_class = (n + granularity - 1) / granularity;
+    if (size_class >= nb_size_classes) {
+      std::free(p);
+      return;
+    }
+    free_frame* frame = static_cast<free_frame*>(p);
+    frame->next = free_lists_[size_class];
+    free_lists_[size_class] = frame;
+  }
+  frame_pool_stats stats() const { return stats_; }
+  // stats of the threads that have exited, plus the current thread
+  static frame_pool_stats total_stats() {
+    frame_pool_stats total = local().stats();
+    total.nb_allocated += exited_nb_allocated().load();
+    total.nb_reused += exited_nb_reused().load();
+    return total;
+  }
+  ~frame_pool() {
+    for (free_frame* list : free_lists_) {
+      while (list != nullptr) {
+        free_frame* next = list->next;
+        std::free(list);
+        list = next;
+      }
+    }
+    exited_nb_allocated() += stats_.nb_allocated;
+    exited_nb_reused() += stats_.nb_reused;
+  }
+private:
+  frame_pool() = default;
+  struct free_frame {
+    free_frame* next;
+  };
+  static std::atomic<std::size_t>& exited_nb_allocated() {
+    static std::atomic<std::size_t> n{0};
+    return n;
+  }
+  static std::atomic<std::size_t>& exited_nb_reused() {
+    static std::atomic<std::size_t> n{0};
+    return n;
+  }
+  free_frame* free_lists_[nb_size_classes] = {};
+  frame_pool_stats stats_;
+};
 template<class T>
 struct promise_allocator {
   static void* alloc(std::size_t n) {
-    return std::malloc(n);
+    return frame_pool::local().alloc(n);
   }
-  static void dealloc(void* p) {
-    std::free(p);
+  static void dealloc(void* p, std::size_t n) {
+    frame_pool::local().dealloc(p, n);
   }
 };
 }
@@ -40,9 +113,9 @@ struct promise {
     using A = promise_allocator<promise<T>>;
     return A::alloc(n);
   }
-  void operator delete(void* p) {
+  void operator delete(void* p, std::size_t n) {
     using A = promise_allocator<promise<T>>;
-    A::dealloc((promise<T>*)p);
+    A::dealloc((promise<T>*)p, n);
   }
   template <class U>
   auto yield_value(U&&value)
@@ -6,10 +6,30 @@
 #include <vector>
 #include <future>
 #include <array>
+#include <set>
+#include <atomic>
+#include <mutex>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <csignal>
+#include <thread>
+#include <random>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <unordered_map>
+#include <string_view>
+#include <cstring>
+#include <cassert>
+#include <filesystem>
+#include <bit>
+#include <numeric>
 #include <gmpxx.h>
 #include <boost/asio/thread_pool.hpp>
 #include <boost/asio.hpp>
 #include "spdlog/spdlog.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
 #include "stopwatch.hpp"
 
 #ifdef ALGO_USE_COROUTINES
@@ -35,35 +55,828 @@ std::ostream & operator<<(std::ostream & os, BigInt v)
   return os;
 }
 
-BigInt gCurrentMaxPersistence = 0;
-std::mutex gCurrentMaxMutex;
+// GmpArena : a per thread allocator for the GMP numbers (installed with InstallGmpArena).
+// Blocks are rounded up to a power of two, and the freed blocks are kept in a free list
+// per size class, so that the temporaries created for each candidate do not reach malloc.
+// A block freed by another thread goes to the free lists of this thread.
+// All the blocks come from malloc: they can always be released with free
+// (this is what happens after the arena of the thread is destroyed).
+class GmpArena
+{
+public:
+  struct Stats
+  {
+    long nb_allocations = 0; // calls to the allocate and reallocate functions
+    long nb_mallocs = 0;     // allocations which were not served from the free lists
+    long bytes = 0;          // bytes currently allocated by this thread (minus those freed by it)
+    long peak_bytes = 0;
+  };
 
+  static constexpr int kMinSizeClass = 4;   // 16 bytes
+  static constexpr int kMaxSizeClass = 20;  // 1MB, bigger blocks go directly to malloc
+  static constexpr std::size_t kMaxCachedBytes = 32 * 1024 * 1024;
 
-inline BigInt OneTransform(BigInt digits)
+  static int SizeClass(std::size_t size)
+  {
+    int size_class = kMinSizeClass;
+    while (((std::size_t)1 << size_class) < size)
+      size_class++;
+    return size_class;
+  }
+
+  void * Allocate(std::size_t size)
+  {
+    stats_.nb_allocations++;
+    int size_class = SizeClass(size);
+    AddBytes((long)1 << size_class);
+    if (size_class <= kMaxSizeClass && free_lists_[size_class] != nullptr)
+    {
+      FreeBlock * block = free_lists_[size_class];
+      free_lists_[size_class] = block->next;
+      cached_bytes_ -= (std::size_t)1 << size_class;
+      return block;
+    }
+    stats_.nb_mallocs++;
+    void * p = std::malloc((std::size_t)1 << size_class);
+    if (p == nullptr)
+      throw std::bad_alloc();
+    return p;
+  }
+
+  void Free(void * p, std::size_t size)
+  {
+    int size_class = SizeClass(size);
+    AddBytes(-((long)1 << size_class));
+    if (size_class > kMaxSizeClass || cached_bytes_ + ((std::size_t)1 << size_class) > kMaxCachedBytes)
+    {
+      std::free(p);
+      return;
+    }
+    FreeBlock * block = static_cast<FreeBlock *>(p);
+    block->next = free_lists_[size_class];
+    free_lists_[size_class] = block;
+    cached_bytes_ += (std::size_t)1 << size_class;
+  }
+
+  void * Reallocate(void * p, std::size_t old_size, std::size_t new_size)
+  {
+    if (SizeClass(old_size) == SizeClass(new_size))
+    {
+      stats_.nb_allocations++;
+      return p;
+    }
+    void * new_p = Allocate(new_size);
+    std::memcpy(new_p, p, std::min(old_size, new_size));
+    Free(p, old_size);
+    return new_p;
+  }
+
+  Stats GetStats() const { return stats_; }
+
+  // the arena of the current thread (nullptr once it has been destroyed, at thread exit)
+  static GmpArena * Local()
+  {
+    if (tDestroyed)
+      return nullptr;
+    thread_local GmpArena arena;
+    return &arena;
+  }
+
+  // sum of the stats of the threads that have exited and of the current thread
+  // (peak_bytes is the biggest peak of a thread)
+  static Stats TotalStats()
+  {
+    Stats total;
+    {
+      std::lock_guard lock(ExitedMutex());
+      total = ExitedStats();
+    }
+    if (GmpArena * arena = Local())
+      Accumulate(total, arena->stats_);
+    return total;
+  }
+
+  ~GmpArena()
+  {
+    for (FreeBlock * list: free_lists_)
+      while (list != nullptr)
+      {
+        FreeBlock * next = list->next;
+        std::free(list);
+        list = next;
+      }
+    {
+      std::lock_guard lock(ExitedMutex());
+      Accumulate(ExitedStats(), stats_);
+    }
+    tDestroyed = true;
+  }
+
+private:
+  GmpArena() = default;
+
+  struct FreeBlock
+  {
+    FreeBlock * next;
+  };
+
+  void AddBytes(long bytes)
+  {
+    stats_.bytes += bytes;
+    stats_.peak_bytes = std::max(stats_.peak_bytes, stats_.bytes);
+  }
+
+  static void Accumulate(Stats & total, const Stats & stats)
+  {
+    total.nb_allocations += stats.nb_allocations;
+    total.nb_mallocs += stats.nb_mallocs;
+    total.bytes += stats.bytes;
+    total.peak_bytes = std::max(total.peak_bytes, stats.peak_bytes);
+  }
+
+  static std::mutex & ExitedMutex() { static std::mutex mutex; return mutex; }
+  static Stats & ExitedStats() { static Stats stats; return stats; }
+  static inline thread_local bool tDestroyed = false;
+
+  std::array<FreeBlock *, kMaxSizeClass + 1> free_lists_ {};
+  std::size_t cached_bytes_ = 0;
+  Stats stats_;
+};
+
+// InstallGmpArena : GMP allocates through the arena of the current thread.
+// Must be called before any GMP number is created.
+void InstallGmpArena()
+{
+  mp_set_memory_functions(
+    [](size_t size) {
+      if (GmpArena * arena = GmpArena::Local())
+        return arena->Allocate(size);
+      return std::malloc(size);
+    },
+    [](void * p, size_t old_size, size_t new_size) {
+      if (GmpArena * arena = GmpArena::Local())
+        return arena->Reallocate(p, old_size, new_size);
+      return std::realloc(p, new_size);
+    },
+    [](void * p, size_t size) {
+      if (GmpArena * arena = GmpArena::Local())
+        arena->Free(p, size);
+      else
+        std::free(p);
+    });
+}
+
+
+// Trace (built with PERSISTENCE_TRACE, recorded with --trace FILE): each thread records spans
+// into its own ring buffer, without lock nor allocation once the buffer exists:
+// - "nb_digits": a digit count, from its first chunk to its last one (on several threads)
+// - "chunk", "produce", "score_batch", "stall": the work of the pool and pipeline threads
+// - "generate" and "score": one candidate out of kTraceSamplePeriod, split between its generation
+//   (since the end of the previous candidate) and its persistence
+// The idle time of a thread is the gap between its spans. When a buffer is full, its oldest spans
+// are overwritten. The buffers outlive their threads, and are written at the end of the search
+// in the Chrome trace format (JSON, for chrome://tracing or ui.perfetto.dev).
+// Without PERSISTENCE_TRACE, Trace, TraceSpan and TraceSampler are empty: the search code is unchanged.
+constexpr long kTraceSamplePeriod = 1024; // a power of two
+
+#ifdef PERSISTENCE_TRACE
+class Trace
+{
+public:
+  static constexpr bool kCompiled = true;
+  static constexpr std::size_t kBufferSize = 1 << 18; // events per thread (a power of two)
+
+  struct Event
+  {
+    const char * name; // a string literal
+    int nb_digits;     // -1 if none
+    bool async;        // a span which may begin and end on different threads
+    long index;        // chunk or batch index, -1 if none
+    long begin_ns;
+    long end_ns;
+  };
+
+  struct WriteStats
+  {
+    long nb_threads = 0;
+    long nb_events = 0;
+    long nb_overwritten = 0;
+  };
+
+  static void Enable(bool enabled = true) { Enabled().store(enabled, std::memory_order_relaxed); }
+  static bool IsEnabled() { return Enabled().load(std::memory_order_relaxed); }
+
+  // Now : nanoseconds since the first call
+  static long Now()
+  {
+    static const auto origin = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+  }
+
+  // Record : adds a span to the buffer of the current thread
+  static void Record(const char * name, long begin_ns, long end_ns, int nb_digits = -1, long index = -1, bool async = false)
+  {
+    ThreadBuffer & buffer = Local();
+    buffer.events[buffer.nb_events++ & (kBufferSize - 1)] = { name, nb_digits, async, index, begin_ns, end_ns };
+  }
+
+  // NameThread : the name of the current thread in the trace ("<role> <thread number>"),
+  // unless it already has one (nothing if the trace is disabled)
+  static void NameThread(const char * role)
+  {
+    if (!IsEnabled())
+      return;
+    ThreadBuffer & buffer = Local();
+    if (buffer.name.empty())
+      buffer.name = std::string(role) + " " + std::to_string(buffer.tid);
+  }
+
+  // WriteChromeTrace : writes the buffers of all the threads.
+  // The threads shall not record while it runs.
+  static WriteStats WriteChromeTrace(std::ostream & os)
+  {
+    std::lock_guard lock(Mutex());
+    WriteStats stats;
+    const char * separator = "\n";
+    auto write_event = [&](const std::string & event) {
+      os << separator << event;
+      separator = ",\n";
+    };
+    auto args = [](const Event & e) {
+      std::string args;
+      if (e.nb_digits >= 0)
+        args += fmt::format("\"nb_digits\":{}", e.nb_digits);
+      if (e.index >= 0)
+        args += fmt::format("{}\"index\":{}", args.empty() ? "" : ",", e.index);
+      return args;
+    };
+
+    os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    for (const auto & buffer: Buffers())
+    {
+      stats.nb_threads++;
+      std::string name = buffer->name.empty() ? "thread " + std::to_string(buffer->tid) : buffer->name;
+      write_event(fmt::format("{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":{},\"args\":{{\"name\":\"{}\"}}}}",
+        buffer->tid, name));
+      std::size_t nb_kept = std::min(buffer->nb_events, kBufferSize);
+      stats.nb_events += nb_kept;
+      stats.nb_overwritten += buffer->nb_events - nb_kept;
+      for (std::size_t i = buffer->nb_events - nb_kept; i < buffer->nb_events; i++)
+      {
+        const Event & e = buffer->events[i & (kBufferSize - 1)];
+        if (e.async)
+        {
+          // the digit counts overlap: they are shown on their own tracks
+          for (auto [phase, ns]: { std::pair('b', e.begin_ns), std::pair('e', e.end_ns) })
+            write_event(fmt::format("{{\"name\":\"{}\",\"cat\":\"{}\",\"id\":{},\"ph\":\"{}\",\"pid\":1,\"tid\":{},\"ts\":{:.3f},\"args\":{{{}}}}}",
+              e.name, e.name, e.nb_digits, phase, buffer->tid, ns / 1e3, args(e)));
+        }
+        else
+          write_event(fmt::format("{{\"name\":\"{}\",\"ph\":\"X\",\"pid\":1,\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f},\"args\":{{{}}}}}",
+            e.name, buffer->tid, e.begin_ns / 1e3, (e.end_ns - e.begin_ns) / 1e3, args(e)));
+      }
+    }
+    os << "\n]}\n";
+    return stats;
+  }
+
+private:
+  struct ThreadBuffer
+  {
+    int tid;
+    std::string name;
+    std::size_t nb_events = 0; // recorded since the start: the buffer holds the last kBufferSize ones
+    std::vector<Event> events = std::vector<Event>(kBufferSize);
+  };
+
+  // the buffer of the current thread, registered on its first event (and never freed)
+  static ThreadBuffer & Local()
+  {
+    thread_local ThreadBuffer * buffer = [] {
+      std::lock_guard lock(Mutex());
+      auto & buffers = Buffers();
+      buffers.push_back(std::make_unique<ThreadBuffer>());
+      buffers.back()->tid = (int)buffers.size();
+      return buffers.back().get();
+    }();
+    return *buffer;
+  }
+
+  static std::atomic<bool> & Enabled() { static std::atomic<bool> enabled(false); return enabled; }
+  static std::mutex & Mutex() { static std::mutex mutex; return mutex; }
+  static std::vector<std::unique_ptr<ThreadBuffer>> & Buffers() { static std::vector<std::unique_ptr<ThreadBuffer>> buffers; return buffers; }
+};
+
+// TraceSpan : records a span from its construction to its destruction
+class TraceSpan
+{
+public:
+  explicit TraceSpan(const char * name, int nb_digits = -1, long index = -1)
+    : name_(name), nb_digits_(nb_digits), index_(index), enabled_(Trace::IsEnabled())
+  {
+    if (enabled_)
+      begin_ns_ = Trace::Now();
+  }
+
+  ~TraceSpan()
+  {
+    if (enabled_)
+      Trace::Record(name_, begin_ns_, Trace::Now(), nb_digits_, index_);
+  }
+
+private:
+  const char * name_;
+  int nb_digits_;
+  long index_;
+  bool enabled_;
+  long begin_ns_ = 0;
+};
+
+// TraceSampler : the "generate" and "score" spans of one candidate out of kTraceSamplePeriod.
+// begin_candidate / end_candidate shall be called around the scoring of each candidate.
+// The first "generate" span starts at the construction of the sampler: in VECTORS mode,
+// it covers the generation of all the candidates of the chunk.
+class TraceSampler
+{
+public:
+  explicit TraceSampler(int nb_digits) : nb_digits_(nb_digits), enabled_(Trace::IsEnabled())
+  {
+    if (enabled_)
+      previous_end_ns_ = Trace::Now();
+  }
+
+  void begin_candidate()
+  {
+    if (enabled_ && (nb_candidates_ & (kTraceSamplePeriod - 1)) == 0)
+    {
+      begin_ns_ = Trace::Now();
+      Trace::Record("generate", previous_end_ns_, begin_ns_, nb_digits_);
+    }
+  }
+
+  void end_candidate()
+  {
+    if (!enabled_)
+      return;
+    long phase = nb_candidates_++ & (kTraceSamplePeriod - 1);
+    if (phase == 0)
+      Trace::Record("score", begin_ns_, Trace::Now(), nb_digits_);
+    if (phase == kTraceSamplePeriod - 1)
+      previous_end_ns_ = Trace::Now();
+  }
+
+private:
+  int nb_digits_;
+  bool enabled_;
+  long nb_candidates_ = 0;
+  long previous_end_ns_ = 0;
+  long begin_ns_ = 0;
+};
+#else
+struct Trace
+{
+  static constexpr bool kCompiled = false;
+  struct WriteStats
+  {
+    long nb_threads = 0;
+    long nb_events = 0;
+    long nb_overwritten = 0;
+  };
+  static void Enable(bool = true) {}
+  static constexpr bool IsEnabled() { return false; }
+  static long Now() { return 0; }
+  static void Record(const char *, long, long, int = -1, long = -1, bool = false) {}
+  static void NameThread(const char *) {}
+  static WriteStats WriteChromeTrace(std::ostream &) { return {}; }
+};
+
+struct TraceSpan
+{
+  explicit TraceSpan(const char *, int = -1, long = -1) {}
+};
+
+struct TraceSampler
+{
+  explicit TraceSampler(int) {}
+  void begin_candidate() {}
+  void end_candidate() {}
+};
+#endif
+
+
+// gCurrentMaxPersistence : the record among all the digit counts, shared by the pool threads
+std::atomic<int> gCurrentMaxPersistence(0);
+
+
+// BaseWord : digits are extracted by words of kDigitsPerWord digits,
+// Base^kDigitsPerWord being the biggest power of Base that fits inside an unsigned long
+// (in base 10: words of 19 digits)
+template<int Base>
+struct BaseWord
+{
+  static_assert(Base >= 2 && Base <= 36, "Bases from 2 to 36 are supported");
+  static constexpr int kDigitsPerWord = []() {
+    int nb_digits = 0;
+    for (unsigned long power = 1; power <= std::numeric_limits<unsigned long>::max() / Base; power *= Base)
+      nb_digits++;
+    return nb_digits;
+  }();
+  static constexpr unsigned long kBasePowDigitsPerWord = []() {
+    unsigned long power = 1;
+    for (int i = 0; i < kDigitsPerWord; i++)
+      power *= Base;
+    return power;
+  }();
+};
+static_assert(sizeof(unsigned long) >= 8, "OneTransform requires 64 bits unsigned long");
+
+constexpr int kDigitsPerWord = BaseWord<10>::kDigitsPerWord;
+constexpr unsigned long kTenPowDigitsPerWord = BaseWord<10>::kBasePowDigitsPerWord;
+static_assert(kDigitsPerWord == 19 && kTenPowDigitsPerWord == 10000000000000000000UL);
+
+// MultiplyWordDigits : product of the last nb_digits digits of word in base Base
+// (or of all its digits if there are more), 0 as soon as a zero digit is found.
+// Base is a constant: the divisions are compiled into multiplications
+template<int Base = 10>
+inline unsigned long MultiplyWordDigits(unsigned long word, int nb_digits)
 {
+  // the product of the digits of a word is at most the word itself: it fits in native integers
+  unsigned long multiplied_word_digits = 1;
+  for (int i = 0; word > 0 || i < nb_digits; i++)
+  {
+    unsigned long last_digit = word % Base;
+    if (last_digit == 0)
+      return 0;
+    multiplied_word_digits *= last_digit;
+    word /= Base;
+  }
+  return multiplied_word_digits;
+}
+
+// DigitHistogram : number of occurrences of each digit (0 to 9) inside a number
+using DigitHistogram = std::array<long, 10>;
+
+// PowersOfTen : the powers 10^(kDigitsPerWord * 2^level), computed once and
+// shared (read-only) by all the threads. They are used in order to split
+// a number in two halves in DigitHistogram.
+class PowersOfTen
+{
+public:
+  static const BigInt & Get(int level)
+  {
+    static PowersOfTen instance;
+    return instance.get(level);
+  }
+
+private:
+  static constexpr int kMaxLevels = 48;
+
+  const BigInt & get(int level)
+  {
+    if (level >= nb_levels_.load(std::memory_order_acquire))
+    {
+      std::lock_guard lock(mutex_);
+      for (int i = nb_levels_.load(std::memory_order_relaxed); i <= level; i++)
+      {
+        if (i == 0)
+          powers_[0] = kTenPowDigitsPerWord;
+        else
+          powers_[i] = powers_[i - 1] * powers_[i - 1];
+        nb_levels_.store(i + 1, std::memory_order_release);
+      }
+    }
+    return powers_[level];
+  }
+
+  std::array<BigInt, kMaxLevels> powers_;
+  std::atomic<int> nb_levels_ { 0 };
+  std::mutex mutex_;
+};
+
+// Below this level (pieces of at most kDigitsPerWord * 2^kHistogramBaseLevel digits),
+// DigitHistogram extracts the words one by one
+constexpr int kHistogramBaseLevel = 3;
+
+// AddWordsDigitHistogram : quadratic version, for small pieces.
+// If nb_digits > 0, v is padded with leading zeros up to nb_digits digits
+inline void AddWordsDigitHistogram(BigInt v, long nb_digits, DigitHistogram & histogram)
+{
+  long nb_digits_done = 0;
+  while (v > 0)
+  {
+    unsigned long word = mpz_fdiv_q_ui(v.get_mpz_t(), v.get_mpz_t(), kTenPowDigitsPerWord);
+    bool is_last_word = (mpz_sgn(v.get_mpz_t()) == 0);
+    int nb_digits_in_word = is_last_word ? 0 : kDigitsPerWord;
+    for (int i = 0; word > 0 || i < nb_digits_in_word; i++)
+    {
+      histogram[word % 10]++;
+      word /= 10;
+      nb_digits_done++;
+    }
+  }
+  if (nb_digits > nb_digits_done)
+    histogram[0] += nb_digits - nb_digits_done;
+}
+
+// AddDigitHistogram : divide and conquer version: v is split in two halves by
+// 10^(kDigitsPerWord * 2^level), so that its cost is the cost of GMP divisions (subquadratic).
+// If nb_digits > 0, v is padded with leading zeros up to nb_digits digits
+inline void AddDigitHistogram(const BigInt & v, long nb_digits, int level, DigitHistogram & histogram)
+{
+  if (nb_digits == 0)
+    while (level >= 0 && v < PowersOfTen::Get(level))
+      level--;
+  if (level < kHistogramBaseLevel)
+  {
+    AddWordsDigitHistogram(v, nb_digits, histogram);
+    return;
+  }
+  BigInt high, low;
+  mpz_fdiv_qr(high.get_mpz_t(), low.get_mpz_t(), v.get_mpz_t(), PowersOfTen::Get(level).get_mpz_t());
+  long nb_low_digits = (long)kDigitsPerWord << level;
+  AddDigitHistogram(high, nb_digits > 0 ? nb_digits - nb_low_digits : 0, level - 1, histogram);
+  AddDigitHistogram(low, nb_low_digits, level - 1, histogram);
+}
+
+inline DigitHistogram ComputeDigitHistogram(const BigInt & v)
+{
+  DigitHistogram histogram {};
+  if (v == 0)
+  {
+    histogram[0] = 1;
+    return histogram;
+  }
+  // the highest level such that 10^(kDigitsPerWord * 2^level) may be <= v
+  long nb_words = (long)(mpz_sizeinbase(v.get_mpz_t(), 10) / kDigitsPerWord);
+  int level = 0;
+  while ((2L << level) <= nb_words)
+    level++;
+  AddDigitHistogram(v, 0, level, histogram);
+  return histogram;
+}
+
+// ProductOfDigits : 2^a.3^b.5^c.7^d, from the digit histogram
+inline BigInt ProductOfDigits(const DigitHistogram & h)
+{
+  BigInt r, power;
+  if (h[0] > 0)
+    return r;
+  mpz_ui_pow_ui(r.get_mpz_t(), 3, h[3] + h[6] + 2 * h[9]);
+  mpz_ui_pow_ui(power.get_mpz_t(), 5, h[5]);
+  r *= power;
+  mpz_ui_pow_ui(power.get_mpz_t(), 7, h[7]);
+  r *= power;
+  mpz_mul_2exp(r.get_mpz_t(), r.get_mpz_t(), h[2] + 2 * h[4] + h[6] + 3 * h[8]);
+  return r;
+}
+
+// OneTransform_Words : extracts the digits by words of kDigitsPerWord digits
+// (quadratic, but it stops at the first zero digit)
+template<int Base = 10>
+inline BigInt OneTransform_Words(BigInt digits)
+{
+  using Word = BaseWord<Base>;
   // Note:
-  // by making multiplied_digits and last_digit thread_local
+  // by making multiplied_digits thread_local
   // we get a speedup factor of 2.5! (no more mallocs)
   thread_local BigInt multiplied_digits(1);
   multiplied_digits = 1;
   while(digits > 0)
   {
-    thread_local BigInt last_digit;
     // the next line computes in one pass the equivalent of:
-    //  "digits = digits / 10" and "last_digit = digits % 10"
-    mpz_fdiv_qr_ui(digits.get_mpz_t(), last_digit.get_mpz_t(), digits.get_mpz_t(), 10);
-    multiplied_digits = multiplied_digits * last_digit;
+    //  "digits = digits / 10^19" and "word = digits % 10^19" (in base 10)
+    unsigned long word = mpz_fdiv_q_ui(digits.get_mpz_t(), digits.get_mpz_t(), Word::kBasePowDigitsPerWord);
+    // inside the most significant word, the leading zeros are not digits
+    bool is_last_word = (mpz_sgn(digits.get_mpz_t()) == 0);
+    unsigned long multiplied_word_digits = MultiplyWordDigits<Base>(word, is_last_word ? 0 : Word::kDigitsPerWord);
+    if (multiplied_word_digits == 0)
+    {
+      // no need to go further, the product will stay 0
+      multiplied_digits = 0;
+      return multiplied_digits;
+    }
+    mpz_mul_ui(multiplied_digits.get_mpz_t(), multiplied_digits.get_mpz_t(), multiplied_word_digits);
+  }
+  return multiplied_digits;
+}
+
+// Number of words checked by OneTransform_Histogram before computing the histogram:
+// one of them contains a zero digit with a probability of 1 - 0.9^76 > 99.9%
+constexpr int kHistogramNbCheckedWords = 4;
+
+// OneTransform_Histogram : subquadratic, from the digit histogram
+inline BigInt OneTransform_Histogram(const BigInt & digits)
+{
+  // the last words are checked first: they usually contain a zero
+  thread_local BigInt high_digits;
+  high_digits = digits;
+  for (int i = 0; i < kHistogramNbCheckedWords; i++)
+  {
+    unsigned long word = mpz_fdiv_q_ui(high_digits.get_mpz_t(), high_digits.get_mpz_t(), kTenPowDigitsPerWord);
+    if (MultiplyWordDigits(word, kDigitsPerWord) == 0)
+      return BigInt(0);
+  }
+  return ProductOfDigits(ComputeDigitHistogram(digits));
+}
+
+// Above this number of digits, OneTransform uses the digit histogram
+// (see bench_one_transform_big in persistence_bench)
+constexpr std::size_t kHistogramMinDigits = 2000;
+
+// (the digit histogram is only implemented in base 10)
+template<int Base = 10>
+inline BigInt OneTransform(BigInt digits)
+{
+  if constexpr (Base == 10)
+    if (mpz_sizeinbase(digits.get_mpz_t(), 10) > kHistogramMinDigits)
+      return OneTransform_Histogram(digits);
+  return OneTransform_Words<Base>(digits);
+}
+
+// Once a value fits in 128 bits, the remaining transforms use native integers
+// (the digit product of a value is at most the value itself: it also fits)
+using NativeUInt = unsigned __int128;
+static_assert(GMP_NUMB_BITS == 64, "BigIntToNativeUInt requires 64 bits limbs");
+
+inline bool FitsNativeUInt(const BigInt & v)
+{
+  return mpz_sizeinbase(v.get_mpz_t(), 2) <= 128;
+}
+
+inline NativeUInt BigIntToNativeUInt(const BigInt & v)
+{
+  NativeUInt low = mpz_getlimbn(v.get_mpz_t(), 0);
+  NativeUInt high = mpz_size(v.get_mpz_t()) > 1 ? mpz_getlimbn(v.get_mpz_t(), 1) : 0;
+  return (high << 64) | low;
+}
+
+template<int Base = 10>
+inline NativeUInt OneTransform_Native(NativeUInt digits)
+{
+  using Word = BaseWord<Base>;
+  NativeUInt multiplied_digits = 1;
+  while (digits > 0)
+  {
+    unsigned long word;
+    if (digits >= Word::kBasePowDigitsPerWord)
+    {
+      word = (unsigned long)(digits % Word::kBasePowDigitsPerWord);
+      digits /= Word::kBasePowDigitsPerWord;
+    }
+    else
+    {
+      word = (unsigned long)digits;
+      digits = 0;
+    }
+    unsigned long multiplied_word_digits = MultiplyWordDigits<Base>(word, digits > 0 ? Word::kDigitsPerWord : 0);
+    if (multiplied_word_digits == 0)
+      return 0;
+    multiplied_digits *= multiplied_word_digits;
   }
   return multiplied_digits;
 }
 
-inline int PersistenceValue(BigInt v)
+// PersistenceValue_Native : the persistence of v, and its multiplicative digital root
+// (the final digit) if root is not nullptr
+template<int Base = 10>
+inline int PersistenceValue_Native(NativeUInt v, int * root = nullptr)
+{
+  int n = 0;
+  while(v >= Base) {
+    v = OneTransform_Native<Base>(v);
+    n++;
+  }
+  if (root)
+    *root = (int)v;
+  return n;
+}
+
+// MemoCache : the persistence of intermediate values, shared by all the pool threads.
+// Only the values that do not fit in 128 bits are stored (for the others, the native
+// path is faster than a lookup).
+// The cache is split into shards, each with its own mutex; once a shard has reached
+// its share of the memory cap, no new value is stored in it.
+class MemoCache
+{
+public:
+  struct Stats
+  {
+    long nb_hits = 0, nb_misses = 0, nb_values = 0;
+    std::size_t memory = 0;
+  };
+
+  explicit MemoCache(std::size_t max_memory)
+    : max_memory_per_shard_(max_memory / kNbShards) {}
+
+  bool Find(const BigInt & v, int & persistence, int & root)
+  {
+    Shard & shard = ShardOf(v);
+    std::lock_guard lock(shard.mutex);
+    auto it = shard.values.find(v);
+    if (it == shard.values.end())
+    {
+      shard.stats.nb_misses++;
+      return false;
+    }
+    shard.stats.nb_hits++;
+    persistence = it->second.persistence;
+    root = it->second.root;
+    return true;
+  }
+
+  void Insert(const BigInt & v, int persistence, int root)
+  {
+    std::size_t memory = sizeof(std::pair<BigInt, Value>) + 2 * sizeof(void *) + mpz_size(v.get_mpz_t()) * sizeof(mp_limb_t);
+    Shard & shard = ShardOf(v);
+    std::lock_guard lock(shard.mutex);
+    if (shard.stats.memory + memory > max_memory_per_shard_)
+      return;
+    if (shard.values.emplace(v, Value { persistence, root }).second)
+    {
+      shard.stats.nb_values++;
+      shard.stats.memory += memory;
+    }
+  }
+
+  Stats GetStats()
+  {
+    Stats total;
+    for (auto & shard: shards_)
+    {
+      std::lock_guard lock(shard.mutex);
+      total.nb_hits += shard.stats.nb_hits;
+      total.nb_misses += shard.stats.nb_misses;
+      total.nb_values += shard.stats.nb_values;
+      total.memory += shard.stats.memory;
+    }
+    return total;
+  }
+
+private:
+  static constexpr std::size_t kNbShards = 64;
+
+  // Value : the remaining persistence of a value, and its multiplicative digital root
+  struct Value
+  {
+    int persistence;
+    int root;
+  };
+
+  struct BigIntHash
+  {
+    std::size_t operator()(const BigInt & v) const
+    {
+      const char * limbs = reinterpret_cast<const char *>(mpz_limbs_read(v.get_mpz_t()));
+      return std::hash<std::string_view>()(std::string_view(limbs, mpz_size(v.get_mpz_t()) * sizeof(mp_limb_t)));
+    }
+  };
+
+  struct Shard
+  {
+    std::mutex mutex;
+    std::unordered_map<BigInt, Value, BigIntHash> values;
+    Stats stats;
+  };
+
+  Shard & ShardOf(const BigInt & v)
+  {
+    // the low bits of the hash select the bucket inside the shard: the shard uses the high bits
+    return shards_[(BigIntHash()(v) >> 32) % kNbShards];
+  }
+
+  std::size_t max_memory_per_shard_;
+  std::array<Shard, kNbShards> shards_;
+};
+
+// gMemoCache : consulted by PersistenceValue after the first transform (nullptr if disabled)
+MemoCache * gMemoCache = nullptr;
+
+// PersistenceValue : the persistence of v in base Base, and its multiplicative digital root
+// if root is not nullptr (the memo cache is only used in base 10)
+template<int Base = 10>
+inline int PersistenceValue(BigInt v, int * root = nullptr)
 {
   int n = 0;
-  while(v >= 10) {
-    v = OneTransform(v);
+  while(v >= Base) {
+    if (FitsNativeUInt(v))
+      return n + PersistenceValue_Native<Base>(BigIntToNativeUInt(v), root);
+    if (Base == 10 && n == 1 && gMemoCache)
+    {
+      int remaining_persistence, final_root;
+      if (!gMemoCache->Find(v, remaining_persistence, final_root))
+      {
+        remaining_persistence = 1 + PersistenceValue<Base>(OneTransform<Base>(v), &final_root);
+        gMemoCache->Insert(v, remaining_persistence, final_root);
+      }
+      if (root)
+        *root = final_root;
+      return n + remaining_persistence;
+    }
+    v = OneTransform<Base>(v);
     n++;
   }
+  if (root)
+    *root = (int)v.get_ui();
   return n;
 }
 
@@ -85,28 +898,30 @@ std::vector<int> numbers_up_to(int max)
   return r;
 }
 
+// AllPossibleTripletsWithSum : all the triplets {v1, v2, v3} with v1 + v2 + v3 = sum
+// (optionally restricted to v1 in [v1_begin, v1_end))
 #if defined(ALGO_USE_VECTORS)
 std::vector<std::array<int, 3>>
-AllPossibleTripletsWithSum(int sum)
+AllPossibleTripletsWithSum(int sum, int v1_begin, int v1_end)
 {
   std::vector<std::array<int, 3>> r;
-  for (auto v1 : numbers_up_to(sum + 1))
+  for (auto v1 : numbers_between(v1_begin, v1_end))
     for (auto v2 : numbers_up_to(sum + 1 - v1))
       r.push_back(std::array<int, 3> { v1, v2, sum - v1 - v2 });
   return r;
 }
 #elif defined(ALGO_USE_COROUTINES)
 conduit::seq<std::array<int, 3>>
-AllPossibleTripletsWithSum(int sum)
+AllPossibleTripletsWithSum(int sum, int v1_begin, int v1_end)
 {
-  for (auto v1 : numbers_up_to(sum + 1))
+  for (auto v1 : numbers_between(v1_begin, v1_end))
     for (auto v2 : numbers_up_to(sum + 1 - v1))
       co_yield std::array<int, 3> { v1, v2, sum - v1 - v2 };
 }
 #elif defined(ALGO_USE_RANGES)
-auto AllPossibleTripletsWithSum(int sum)
+auto AllPossibleTripletsWithSum(int sum, int v1_begin, int v1_end)
 {
-  return view::for_each(view::ints(0, sum + 1), [=](int v1) {
+  return view::for_each(view::ints(v1_begin, v1_end), [=](int v1) {
     return view::for_each(view::ints(0, sum + 1 - v1), [=](int v2) {
       return ranges::yield(std::array<int, 3> { v1, v2, sum - v1 - v2 });
     });
@@ -114,25 +929,191 @@ auto AllPossibleTripletsWithSum(int sum)
 }
 #endif
 
-inline BigInt DigitsToBigInt(const std::vector<int> & digits)
+auto AllPossibleTripletsWithSum(int sum)
 {
-  char buffer[10000];
-  auto len = digits.size();
-  for (std::size_t i = 0; i < len; i++)
-    buffer[i] = '0' + digits[i];
-  buffer[len] = '\0';
-  auto r = BigInt(buffer);
-  return r;
+  return AllPossibleTripletsWithSum(sum, 0, sum + 1);
 }
 
+// Gray traversal of the triplets {nb_9, nb_8, nb_7}: the rows of fixed nb_9 are walked
+// alternately with increasing and decreasing nb_8, so that two consecutive triplets
+// differ by a single digit (GraySwap). The first product can then be updated
+// with one small multiplication and one exact division per candidate.
+enum class GraySwap { None, Swap7To8, Swap8To7, Swap8To9, Swap7To9 };
 
-#if ! defined(ALGO_USE_RANGES)
-// candidateNumbersWithNbDigits : returns a sequence
-// of all the candidate numbers that shall be tested
-// for a given number of digits
+struct GrayTriplet
+{
+  std::array<int, 3> triplet;
+  GraySwap swap; // from the previous triplet (None for the first one)
+};
+
+// GraySwapBefore : the swap that leads to the i-th triplet of the row v1
+inline GraySwap GraySwapBefore(int v1, int i, int v1_begin)
+{
+  bool ascending = ((v1 - v1_begin) % 2 == 0);
+  if (i > 0)
+    return ascending ? GraySwap::Swap7To8 : GraySwap::Swap8To7;
+  if (v1 == v1_begin)
+    return GraySwap::None;
+  // the previous row ended with nb_7 = 0 if it was ascending, and with nb_8 = 0 otherwise
+  return ascending ? GraySwap::Swap7To9 : GraySwap::Swap8To9;
+}
+
+inline GrayTriplet GrayTripletAt(int sum, int v1, int i, int v1_begin)
+{
+  bool ascending = ((v1 - v1_begin) % 2 == 0);
+  int v2 = ascending ? i : sum - v1 - i;
+  return GrayTriplet { { v1, v2, sum - v1 - v2 }, GraySwapBefore(v1, i, v1_begin) };
+}
+
+// AllPossibleTripletsWithSum_Gray : the same triplets as AllPossibleTripletsWithSum, in the Gray order
+#if defined(ALGO_USE_VECTORS)
+std::vector<GrayTriplet>
+AllPossibleTripletsWithSum_Gray(int sum, int v1_begin, int v1_end)
+{
+  std::vector<GrayTriplet> r;
+  for (auto v1 : numbers_between(v1_begin, v1_end))
+    for (auto i : numbers_up_to(sum + 1 - v1))
+      r.push_back(GrayTripletAt(sum, v1, i, v1_begin));
+  return r;
+}
+#elif defined(ALGO_USE_COROUTINES)
+conduit::seq<GrayTriplet>
+AllPossibleTripletsWithSum_Gray(int sum, int v1_begin, int v1_end)
+{
+  for (auto v1 : numbers_between(v1_begin, v1_end))
+    for (auto i : numbers_up_to(sum + 1 - v1))
+      co_yield GrayTripletAt(sum, v1, i, v1_begin);
+}
+#elif defined(ALGO_USE_RANGES)
+auto AllPossibleTripletsWithSum_Gray(int sum, int v1_begin, int v1_end)
+{
+  return view::for_each(view::ints(v1_begin, v1_end), [=](int v1) {
+    return view::transform(view::ints(0, sum + 1 - v1), [=](int i) {
+      return GrayTripletAt(sum, v1, i, v1_begin);
+    });
+  });
+}
+#endif
+
+inline BigInt DigitsToBigInt(const std::vector<int> & digits)
+{
+  std::string buffer(digits.size(), '0');
+  for (std::size_t i = 0; i < digits.size(); i++)
+    buffer[i] = '0' + digits[i];
+  return BigInt(buffer);
+}
+
+
+// DigitCounts : a candidate number, stored as the number of occurrences
+// of each allowed digit.
+// Since the order of the digits does not matter, this is enough
+// in order to compute its first product: 2^(nb_2 + 2.nb_4 + 3.nb_8) * 3^(nb_3 + 2.nb_9) * 7^nb_7
+// The decimal form (DigitCountsToBigInt) is only needed for display.
 //
-// The digits sequence shall be ordered from smallest to biggest
-// with the following rules:
+// Note: there is no need to cache the persistence by first product:
+// the digit rules make (exp2, exp3, exp7) unique among all the candidates,
+// whatever their number of digits.
+// (exp2 % 3 gives nb_2 / nb_4, exp3 % 2 gives nb_3, and then nb_8, nb_9 and nb_7 follow)
+struct DigitCounts
+{
+  int nb_2 = 0, nb_3 = 0, nb_4 = 0, nb_7 = 0, nb_8 = 0, nb_9 = 0;
+
+  int nbDigits() const { return nb_2 + nb_3 + nb_4 + nb_7 + nb_8 + nb_9; }
+  int exp2() const { return nb_2 + 2 * nb_4 + 3 * nb_8; }
+  int exp3() const { return nb_3 + 2 * nb_9; }
+  int exp7() const { return nb_7; }
+  std::array<int, 3> primeExponents() const { return { exp2(), exp3(), exp7() }; }
+};
+
+inline std::vector<int> DigitCountsToDigits(const DigitCounts & c)
+{
+  std::vector<int> digits;
+  digits.reserve(c.nbDigits());
+  digits.insert(digits.end(), c.nb_2, 2);
+  digits.insert(digits.end(), c.nb_3, 3);
+  digits.insert(digits.end(), c.nb_4, 4);
+  digits.insert(digits.end(), c.nb_7, 7);
+  digits.insert(digits.end(), c.nb_8, 8);
+  digits.insert(digits.end(), c.nb_9, 9);
+  return digits;
+}
+
+inline BigInt DigitCountsToBigInt(const DigitCounts & c)
+{
+  return DigitsToBigInt(DigitCountsToDigits(c));
+}
+
+// FirstProduct : equivalent to OneTransform(DigitCountsToBigInt(c)),
+// but computed directly from the digit counts
+inline BigInt FirstProduct(const DigitCounts & c)
+{
+  thread_local BigInt power_7;
+  BigInt r;
+  mpz_ui_pow_ui(r.get_mpz_t(), 3, c.exp3());
+  mpz_ui_pow_ui(power_7.get_mpz_t(), 7, c.exp7());
+  r *= power_7;
+  mpz_mul_2exp(r.get_mpz_t(), r.get_mpz_t(), c.exp2());
+  return r;
+}
+
+inline int PersistenceValue(const DigitCounts & c, int * root = nullptr)
+{
+  if (c.nbDigits() <= 1)
+    return PersistenceValue(DigitCountsToBigInt(c), root);
+  return 1 + PersistenceValue(FirstProduct(c), root);
+}
+
+// GrayCandidate : a candidate from a Gray traversal (see GraySwap)
+struct GrayCandidate
+{
+  DigitCounts counts;
+  GraySwap swap;
+};
+
+// ApplyGraySwap : updates first_product, from the first product of the previous candidate
+// to the first product of candidate
+inline void ApplyGraySwap(BigInt & first_product, const GrayCandidate & candidate)
+{
+  mpz_ptr p = first_product.get_mpz_t();
+  switch (candidate.swap)
+  {
+    case GraySwap::None:
+      first_product = FirstProduct(candidate.counts);
+      break;
+    case GraySwap::Swap7To8:
+      mpz_divexact_ui(p, p, 7);
+      mpz_mul_2exp(p, p, 3);
+      break;
+    case GraySwap::Swap8To7:
+      mpz_tdiv_q_2exp(p, p, 3);
+      mpz_mul_ui(p, p, 7);
+      break;
+    case GraySwap::Swap8To9:
+      mpz_tdiv_q_2exp(p, p, 3);
+      mpz_mul_ui(p, p, 9);
+      break;
+    case GraySwap::Swap7To9:
+      mpz_divexact_ui(p, p, 7);
+      mpz_mul_ui(p, p, 9);
+      break;
+  }
+}
+
+
+// NbTripletsWithSum : number of triplets {nb_9, nb_8, nb_7} with sum m
+inline long NbTripletsWithSum(long m)
+{
+  return m < 0 ? 0 : (m + 1) * (m + 2) / 2;
+}
+
+// NbTripletsBeforeRow : number of triplets with sum m and nb_9 < v
+inline long NbTripletsBeforeRow(long m, long v)
+{
+  return v * (m + 1) - v * (v - 1) / 2;
+}
+
+// The candidates for a given number of digits are ordered
+// from smallest to biggest with the following rules:
 // "0" : None
 // "1" : None
 // "2" : 1 max
@@ -143,17 +1124,30 @@ inline BigInt DigitsToBigInt(const std::vector<int> & digits)
 // "7" : as many as desired
 // "8" : as many as desired
 // "9" : as many as desired
-#if defined(ALGO_USE_VECTORS)
-std::vector<BigInt> candidateNumbersWithNbDigits(int nbDigits)
-#elif defined(ALGO_USE_COROUTINES)
-conduit::seq<BigInt> candidateNumbersWithNbDigits(int nbDigits)
-#endif
+//
+// CandidateChunk : a slice of these candidates, with fixed nb_2, nb_3, nb_4
+// and with nb_9 in [nb_9_begin, nb_9_end).
+// Chunks can be processed in parallel, in order to split the work for one number of digits.
+struct CandidateChunk
 {
-  #ifdef ALGO_USE_VECTORS
-  std::vector<BigInt> result;
-  #endif
+  int nb_digits;
+  int nb_2, nb_3, nb_4;
+  int nb_9_begin, nb_9_end;
 
-  std::vector<int> digits(nbDigits, 5); // initialize all with 5 (5 is an incoherent value)
+  int nb_789() const { return nb_digits - nb_2 - nb_3 - nb_4; }
+  // there are (nb_789 + 1 - nb_9) candidates for a given nb_9
+  long nb_candidates() const
+  {
+    long m = nb_789();
+    return NbTripletsBeforeRow(m, nb_9_end) - NbTripletsBeforeRow(m, nb_9_begin);
+  }
+};
+
+// CandidateChunks : splits the candidates for a given number of digits into chunks,
+// in the candidates order. Each chunk holds about nb_candidates_per_chunk candidates
+// (by default, one chunk for each possible value of nb_2, nb_3, nb_4)
+std::vector<CandidateChunk> CandidateChunks(int nbDigits, long nb_candidates_per_chunk = 0)
+{
   static auto range_3 = std::vector<int> { 1, 0 };
   static auto range_2_4 = std::vector< std::pair<int, int> >
   {
@@ -162,67 +1156,184 @@ conduit::seq<BigInt> candidateNumbersWithNbDigits(int nbDigits)
     { 0, 0 }
   };
 
+  std::vector<CandidateChunk> chunks;
   for (auto nb_3: range_3)
   {
     for (auto v_2_4: range_2_4)
     {
-      int nb_2 = v_2_4.first;
-      int nb_4 = v_2_4.second;
-
-      // Fill start of array with 2, 3, and 4 as needed
-      int idx234 = 0;
-      for (int i = 0; i < nb_2; i++) {
-        digits[idx234] = 2;
-        idx234++;
-      }
-      for (int i = 0; i < nb_3; i++) {
-        digits[idx234] = 3;
-        idx234++;
-      }
-      for (int i = 0; i < nb_4; i++) {
-        digits[idx234] = 4;
-        idx234++;
-      }
-
-      int nb_789 = nbDigits - nb_2 - nb_3 - nb_4;
-      auto all_triplets_789 = AllPossibleTripletsWithSum(nb_789);
-      for (auto triplet_789 : all_triplets_789 )
+      CandidateChunk chunk { nbDigits, v_2_4.first, nb_3, v_2_4.second, 0, 0 };
+      int nb_789 = chunk.nb_789();
+      if (nb_789 < 0)
+        continue;
+      // there are (nb_789 + 1 - nb_9) candidates for a given nb_9
+      long nb_candidates_in_chunk = 0;
+      for (int nb_9 = 0; nb_9 <= nb_789; nb_9++)
       {
-        // digits 7 to 9 start after 234
-        int idx789 =idx234;
-
-        int nb_7 = triplet_789[2], nb_8 = triplet_789[1], nb_9 = triplet_789[0];
-        for (int i = 0; i < nb_7; i++) {
-          digits[idx789] = 7;
-          idx789++;
-        }
-        for (int i = 0; i < nb_8; i++) {
-          digits[idx789] = 8;
-          idx789++;
+        nb_candidates_in_chunk += nb_789 + 1 - nb_9;
+        bool is_last = (nb_9 == nb_789);
+        if (is_last || (nb_candidates_per_chunk > 0 && nb_candidates_in_chunk >= nb_candidates_per_chunk))
+        {
+          chunk.nb_9_end = nb_9 + 1;
+          chunks.push_back(chunk);
+          chunk.nb_9_begin = chunk.nb_9_end;
+          nb_candidates_in_chunk = 0;
         }
-        for (int i = 0; i < nb_9; i++) {
-          digits[idx789] = 9;
-          idx789++;
-        }
-        auto bigInt = DigitsToBigInt(digits);
-
-        #ifdef ALGO_USE_VECTORS
-        result.push_back(bigInt);
-        #endif
-        #ifdef ALGO_USE_COROUTINES
-        co_yield bigInt;
-        #endif
       }
     }
   }
+  return chunks;
+}
+
+
+#if ! defined(ALGO_USE_RANGES)
+// candidateDigitCountsInChunk : returns a sequence
+// of all the candidate numbers inside a chunk
+#if defined(ALGO_USE_VECTORS)
+std::vector<DigitCounts> candidateDigitCountsInChunk(const CandidateChunk & chunk)
+#elif defined(ALGO_USE_COROUTINES)
+conduit::seq<DigitCounts> candidateDigitCountsInChunk(CandidateChunk chunk)
+#endif
+{
+  #ifdef ALGO_USE_VECTORS
+  std::vector<DigitCounts> result;
+  #endif
+
+  DigitCounts c;
+  c.nb_2 = chunk.nb_2;
+  c.nb_3 = chunk.nb_3;
+  c.nb_4 = chunk.nb_4;
+
+  auto all_triplets_789 = AllPossibleTripletsWithSum(chunk.nb_789(), chunk.nb_9_begin, chunk.nb_9_end);
+  for (auto triplet_789 : all_triplets_789 )
+  {
+    c.nb_7 = triplet_789[2];
+    c.nb_8 = triplet_789[1];
+    c.nb_9 = triplet_789[0];
+
+    #ifdef ALGO_USE_VECTORS
+    result.push_back(c);
+    #endif
+    #ifdef ALGO_USE_COROUTINES
+    co_yield c;
+    #endif
+  }
+
+  #ifdef ALGO_USE_VECTORS
+  return result;
+  #endif
+}
+
+// candidateDigitCountsInChunk_Gray : the candidates of a chunk, in the Gray order
+#if defined(ALGO_USE_VECTORS)
+std::vector<GrayCandidate> candidateDigitCountsInChunk_Gray(const CandidateChunk & chunk)
+#elif defined(ALGO_USE_COROUTINES)
+conduit::seq<GrayCandidate> candidateDigitCountsInChunk_Gray(CandidateChunk chunk)
+#endif
+{
+  #ifdef ALGO_USE_VECTORS
+  std::vector<GrayCandidate> result;
+  #endif
+
+  GrayCandidate c;
+  c.counts.nb_2 = chunk.nb_2;
+  c.counts.nb_3 = chunk.nb_3;
+  c.counts.nb_4 = chunk.nb_4;
+
+  auto all_triplets_789 = AllPossibleTripletsWithSum_Gray(chunk.nb_789(), chunk.nb_9_begin, chunk.nb_9_end);
+  for (auto gray_triplet_789 : all_triplets_789 )
+  {
+    c.counts.nb_7 = gray_triplet_789.triplet[2];
+    c.counts.nb_8 = gray_triplet_789.triplet[1];
+    c.counts.nb_9 = gray_triplet_789.triplet[0];
+    c.swap = gray_triplet_789.swap;
+
+    #ifdef ALGO_USE_VECTORS
+    result.push_back(c);
+    #endif
+    #ifdef ALGO_USE_COROUTINES
+    co_yield c;
+    #endif
+  }
 
   #ifdef ALGO_USE_VECTORS
   return result;
   #endif
 }
 
+// candidateDigitCountsWithNbDigits : returns a sequence
+// of all the candidate numbers that shall be tested
+// for a given number of digits
+#if defined(ALGO_USE_VECTORS)
+std::vector<DigitCounts> candidateDigitCountsWithNbDigits(int nbDigits)
+{
+  std::vector<DigitCounts> result;
+  for (const auto & chunk : CandidateChunks(nbDigits))
+  {
+    auto chunk_candidates = candidateDigitCountsInChunk(chunk);
+    result.insert(result.end(), chunk_candidates.begin(), chunk_candidates.end());
+  }
+  return result;
+}
+
+std::vector<BigInt> candidateNumbersWithNbDigits(int nbDigits)
+{
+  std::vector<BigInt> result;
+  for (const auto & c : candidateDigitCountsWithNbDigits(nbDigits))
+    result.push_back(DigitCountsToBigInt(c));
+  return result;
+}
+#elif defined(ALGO_USE_COROUTINES)
+conduit::seq<DigitCounts> candidateDigitCountsWithNbDigits(int nbDigits)
+{
+  for (const auto & chunk : CandidateChunks(nbDigits))
+    for (auto c : candidateDigitCountsInChunk(chunk))
+      co_yield c;
+}
+
+conduit::seq<BigInt> candidateNumbersWithNbDigits(int nbDigits)
+{
+  for (auto c : candidateDigitCountsWithNbDigits(nbDigits))
+    co_yield DigitCountsToBigInt(c);
+}
+#endif
+
 #elif defined(ALGO_USE_RANGES)
-auto candidateNumbersWithNbDigits(int nbDigits)
+auto candidateDigitCountsInChunk(const CandidateChunk & chunk)
+{
+  return view::transform(
+    AllPossibleTripletsWithSum(chunk.nb_789(), chunk.nb_9_begin, chunk.nb_9_end),
+    [=](auto triplet_789)
+    {
+      DigitCounts c;
+      c.nb_2 = chunk.nb_2;
+      c.nb_3 = chunk.nb_3;
+      c.nb_4 = chunk.nb_4;
+      c.nb_7 = triplet_789[2];
+      c.nb_8 = triplet_789[1];
+      c.nb_9 = triplet_789[0];
+      return c;
+    });
+}
+
+auto candidateDigitCountsInChunk_Gray(const CandidateChunk & chunk)
+{
+  return view::transform(
+    AllPossibleTripletsWithSum_Gray(chunk.nb_789(), chunk.nb_9_begin, chunk.nb_9_end),
+    [=](auto gray_triplet_789)
+    {
+      GrayCandidate c;
+      c.counts.nb_2 = chunk.nb_2;
+      c.counts.nb_3 = chunk.nb_3;
+      c.counts.nb_4 = chunk.nb_4;
+      c.counts.nb_7 = gray_triplet_789.triplet[2];
+      c.counts.nb_8 = gray_triplet_789.triplet[1];
+      c.counts.nb_9 = gray_triplet_789.triplet[0];
+      c.swap = gray_triplet_789.swap;
+      return c;
+    });
+}
+
+auto candidateDigitCountsWithNbDigits(int nbDigits)
 {
   static auto range_3 = std::vector<int> { 1, 0 };
   static auto range_2_4 = std::vector< std::pair<int, int> >
@@ -238,73 +1349,160 @@ auto candidateNumbersWithNbDigits(int nbDigits)
     {
       int nb_2 = v_2_4.first;
       int nb_4 = v_2_4.second;
-
       int nb_789 = nbDigits - nb_2 - nb_3 - nb_4;
-
-      return view::for_each(AllPossibleTripletsWithSum(nb_789), [=](auto triplet_789)
-      {
-        //return ranges::yield(BigInt(3));
-        std::vector<int> digits(nbDigits, 5); // initialize all with 5 (5 is an incoherent value)
-        // Fill start of array with 2, 3, and 4 as needed
-        int idx234 = 0;
-        for (int i = 0; i < nb_2; i++) {
-          digits[idx234] = 2;
-          idx234++;
-        }
-        for (int i = 0; i < nb_3; i++) {
-          digits[idx234] = 3;
-          idx234++;
-        }
-        for (int i = 0; i < nb_4; i++) {
-          digits[idx234] = 4;
-          idx234++;
-        }
-
-        // digits 7 to 9 start after 234
-        int idx789 =idx234;
-
-        int nb_7 = triplet_789[2], nb_8 = triplet_789[1], nb_9 = triplet_789[0];
-        for (int i = 0; i < nb_7; i++) {
-          digits[idx789] = 7;
-          idx789++;
-        }
-        for (int i = 0; i < nb_8; i++) {
-          digits[idx789] = 8;
-          idx789++;
-        }
-        for (int i = 0; i < nb_9; i++) {
-          digits[idx789] = 9;
-          idx789++;
-        }
-        auto bigInt = DigitsToBigInt(digits);
-        return ranges::yield(bigInt);
-      });
+      CandidateChunk chunk { nbDigits, nb_2, nb_3, nb_4, 0, std::max(nb_789 + 1, 0) };
+      return candidateDigitCountsInChunk(chunk);
     });
   });
 }
+
+auto candidateNumbersWithNbDigits(int nbDigits)
+{
+  return view::transform(candidateDigitCountsWithNbDigits(nbDigits), DigitCountsToBigInt);
+}
 #endif // #elif defined(ALGO_USE_RANGES)
 
 
-inline int TestOneNumber(BigInt number)
+// Random access to the candidates: the candidates of a number of digits are numbered
+// in the order of candidateDigitCountsWithNbDigits. They are made of 6 blocks
+// (nb_3, then nb_2 / nb_4 fixed), and inside a block of nb_789 = m digits,
+// the row nb_9 = v holds the m + 1 - v candidates with nb_8 = 0 .. m - v.
+
+// CandidateBlocks : {nb_2, nb_3, nb_4} of the 6 blocks, in the candidates order
+const std::array<std::array<int, 3>, 6> kCandidateBlocks {{
+  { 1, 1, 0 }, { 0, 1, 1 }, { 0, 1, 0 }, { 1, 0, 0 }, { 0, 0, 1 }, { 0, 0, 0 }
+}};
+
+// NbCandidatesWithNbDigits : number of candidates for a given number of digits
+long NbCandidatesWithNbDigits(int nbDigits)
 {
-  int persistence = PersistenceValue(number);
-  bool isNewMax = [&]() {
-    std::lock_guard lock(gCurrentMaxMutex);
-    if (persistence <= gCurrentMaxPersistence)
-      return false;
-    else {
-      gCurrentMaxPersistence = persistence;
-      return true;
+  long nb = 0;
+  for (const auto & block: kCandidateBlocks)
+    nb += NbTripletsWithSum(nbDigits - block[0] - block[1] - block[2]);
+  return nb;
+}
+
+// CandidateAt : the candidate number index (0 <= index < NbCandidatesWithNbDigits)
+DigitCounts CandidateAt(int nbDigits, long index)
+{
+  for (const auto & block: kCandidateBlocks)
+  {
+    if (index < 0)
+      break;
+    long m = nbDigits - block[0] - block[1] - block[2];
+    long nb_in_block = NbTripletsWithSum(m);
+    if (index >= nb_in_block)
+    {
+      index -= nb_in_block;
+      continue;
     }
-  }();
-  if (isNewMax)
+    // the row: the biggest nb_9 with NbTripletsBeforeRow(m, nb_9) <= index
+    long nb_9_low = 0, nb_9_high = m;
+    while (nb_9_low < nb_9_high)
+    {
+      long middle = (nb_9_low + nb_9_high + 1) / 2;
+      if (NbTripletsBeforeRow(m, middle) <= index)
+        nb_9_low = middle;
+      else
+        nb_9_high = middle - 1;
+    }
+    DigitCounts c;
+    c.nb_2 = block[0];
+    c.nb_3 = block[1];
+    c.nb_4 = block[2];
+    c.nb_9 = (int)nb_9_low;
+    c.nb_8 = (int)(index - NbTripletsBeforeRow(m, nb_9_low));
+    c.nb_7 = (int)(m - c.nb_9 - c.nb_8);
+    return c;
+  }
+  throw std::out_of_range("CandidateAt: index out of range");
+}
+
+// NextCandidate : the candidate that follows c (whose index is index)
+inline DigitCounts NextCandidate(int nbDigits, const DigitCounts & c, long index)
+{
+  DigitCounts next = c;
+  if (next.nb_7 > 0)
+  {
+    next.nb_8++;
+    next.nb_7--;
+  }
+  else if (next.nb_8 > 0)
+  {
+    next.nb_9++;
+    next.nb_7 = next.nb_8 - 1;
+    next.nb_8 = 0;
+  }
+  else // last candidate of the block
+    next = CandidateAt(nbDigits, index + 1);
+  return next;
+}
+
+// candidateDigitCountsInRange : the candidates number index_begin to index_end (excluded),
+// without walking the previous ones
+#if defined(ALGO_USE_VECTORS)
+std::vector<DigitCounts> candidateDigitCountsInRange(int nbDigits, long index_begin, long index_end)
+{
+  std::vector<DigitCounts> result;
+  if (index_begin >= index_end)
+    return result;
+  result.reserve(index_end - index_begin);
+  DigitCounts c = CandidateAt(nbDigits, index_begin);
+  for (long index = index_begin; ; index++)
+  {
+    result.push_back(c);
+    if (index + 1 == index_end)
+      break;
+    c = NextCandidate(nbDigits, c, index);
+  }
+  return result;
+}
+#elif defined(ALGO_USE_COROUTINES)
+conduit::seq<DigitCounts> candidateDigitCountsInRange(int nbDigits, long index_begin, long index_end)
+{
+  if (index_begin >= index_end)
+    co_return;
+  DigitCounts c = CandidateAt(nbDigits, index_begin);
+  for (long index = index_begin; ; index++)
   {
-    spdlog::warn("New max at {} with persistence={}", number.get_str(), persistence);
-    gCurrentMaxPersistence = persistence;
+    co_yield c;
+    if (index + 1 == index_end)
+      break;
+    c = NextCandidate(nbDigits, c, index);
   }
+}
+#elif defined(ALGO_USE_RANGES)
+auto candidateDigitCountsInRange(int nbDigits, long index_begin, long index_end)
+{
+  return view::transform(view::ints(index_begin, std::max(index_begin, index_end)),
+    [=](long index) { return CandidateAt(nbDigits, index); });
+}
+#endif
+
+
+// TestOneNumber : updates the global record with the persistence of a candidate
+// (the records are logged by RecordLog, in the order of the digit counts)
+inline int TestOneNumber(int persistence)
+{
+  // thread_local copy of the record: the shared record is only accessed
+  // when this persistence might beat it (the record only increases)
+  thread_local int known_max_persistence = 0;
+  if (persistence <= known_max_persistence)
+    return persistence;
+
+  int current_max = gCurrentMaxPersistence.load(std::memory_order_relaxed);
+  bool isNewMax = false;
+  while (persistence > current_max && !isNewMax)
+    isNewMax = gCurrentMaxPersistence.compare_exchange_weak(current_max, persistence, std::memory_order_relaxed);
+  known_max_persistence = isNewMax ? persistence : current_max;
   return persistence;
 }
 
+inline int TestOneNumber(const DigitCounts & candidate)
+{
+  return TestOneNumber(PersistenceValue(candidate));
+}
+
 // Checks the conjecture :
 // all maximum persistence number >= 10^157
 // are under the form 237777777....
@@ -321,80 +1519,2587 @@ bool checkConjecture237(BigInt n)
   return true;
 }
 
-void process_for_nb_digits(int nb_digits)
+// The candidates with a bigger persistence are counted in this one (the biggest known persistence is 11)
+constexpr int kMaxDistributionPersistence = 15;
+
+// PersistenceDistribution : the number of candidates for each persistence and multiplicative digital root
+// (the final digit: 0 as soon as a number of the chain has a zero digit)
+struct PersistenceDistribution
 {
-  spdlog::info("Starting nb_digits={}", nb_digits);
-  stopwatch timer;
-  int max_persistence_this_loop = -1;
-  BigInt record_holder(0);
-  for (auto number: candidateNumbersWithNbDigits(nb_digits))
+  std::array<std::array<long, 10>, kMaxDistributionPersistence + 1> nb_candidates {};
+
+  void add(int persistence, int root)
   {
-    int persistence = TestOneNumber(number);
-    if (persistence > max_persistence_this_loop) {
-      max_persistence_this_loop = persistence;
-      record_holder = number;
-    }
+    nb_candidates[std::min(persistence, kMaxDistributionPersistence)][root]++;
   }
-  spdlog::info("Finished nb_digits={}\n"
-    "nb_digits,time,max_persistence,where:{},{},{},{}",
-    nb_digits,
-    nb_digits, timer.elapsed(), max_persistence_this_loop, record_holder.get_str()
-  );
-  bool conjecture_test = checkConjecture237(record_holder);
-  if (!conjecture_test)
+
+  PersistenceDistribution & operator+=(const PersistenceDistribution & d)
   {
-    spdlog::warn("Conjecture not verified for nb_digits={} persistence={} for {}\n",
-      nb_digits, max_persistence_this_loop, record_holder.get_str() );
+    for (int persistence = 0; persistence <= kMaxDistributionPersistence; persistence++)
+      for (int root = 0; root < 10; root++)
+        nb_candidates[persistence][root] += d.nb_candidates[persistence][root];
+    return *this;
   }
-}
 
-#ifndef UNIT_TEST
-int main()
-{
-  // Launch the search inside a pool thread
-  int nb_cores = 16;
-  boost::asio::thread_pool pool(nb_cores);
-  for (auto nb_digits : numbers_between(4, 100))
+  bool operator==(const PersistenceDistribution & d) const = default;
+
+  long total() const
   {
-    boost::asio::post(pool, [nb_digits]() {
-      process_for_nb_digits(nb_digits);
-    });
+    long n = 0;
+    for (const auto & by_root: nb_candidates)
+      for (long nb: by_root)
+        n += nb;
+    return n;
   }
-  pool.join();
-}
 
+  // to_string / from_string : the non-zero counts, as "persistence:root:nb_candidates" separated by ';'
+  std::string to_string() const
+  {
+    std::string s;
+    for (int persistence = 0; persistence <= kMaxDistributionPersistence; persistence++)
+      for (int root = 0; root < 10; root++)
+        if (nb_candidates[persistence][root] > 0)
+          s += fmt::format("{}{}:{}:{}", s.empty() ? "" : ";", persistence, root, nb_candidates[persistence][root]);
+    return s;
+  }
 
-#else
+  // returns false if s is malformed
+  bool from_string(const std::string & s)
+  {
+    *this = PersistenceDistribution();
+    std::istringstream ss(s);
+    std::string cell;
+    while (std::getline(ss, cell, ';'))
+    {
+      std::istringstream cell_ss(cell);
+      int persistence, root;
+      long nb;
+      char sep1, sep2;
+      if (!(cell_ss >> persistence >> sep1 >> root >> sep2 >> nb) || sep1 != ':' || sep2 != ':' || !cell_ss.eof()
+          || persistence < 0 || persistence > kMaxDistributionPersistence || root < 0 || root >= 10)
+        return false;
+      nb_candidates[persistence][root] += nb;
+    }
+    return true;
+  }
+};
 
-///////   Unit Tests below
-TEST_CASE("Playground")
+// ChunkResult : the best candidate found inside one or several chunks, and the distribution of their persistence.
+// The chunks are processed with a local ChunkResult: the counters of the distribution are only merged
+// when the digit count is completed (reduce_chunk_results)
+struct ChunkResult
 {
-  // std::cout << PersistenceValue(BigInt("277777788888899")).get_str() << std::endl;
-  // return 0;
-
-  // for (auto v: candidateNumbersWithNbDigits(3))
-  //   std::cout << v.get_str()<< "\n";
+  int max_persistence = -1;
+  DigitCounts record_holder;
+  long nb_candidates = 0;
+  double cpu_time = 0.;
+  PersistenceDistribution distribution;
+};
 
-  // for (auto v: AllPossibleTripletsWithSum(4))
-  //   std::cout << v[0] << "," << v[1] << "," << v[2] << "\n";
+// IsBeforeInChunk : true if a comes before b in the candidates order
+// (a and b shall belong to the same chunk)
+inline bool IsBeforeInChunk(const DigitCounts & a, const DigitCounts & b)
+{
+  return std::make_pair(a.nb_9, a.nb_8) < std::make_pair(b.nb_9, b.nb_8);
 }
 
-TEST_CASE("BigInt divide & remainder by ten")
+// AddCandidateResult : adds a candidate with its persistence to the result r of its chunk
+// (in case of a tie, the record holder is the first candidate in the candidates order)
+inline void AddCandidateResult(ChunkResult & r, const DigitCounts & candidate, int persistence)
 {
-  BigInt n("4553435645654334326577686587487773537637376387367676765753756664357452435234523534343553265654654437645657474777737"), d(10);
-  BigInt quotient(0), remainder(0);
-  mpz_fdiv_qr_ui (quotient.get_mpz_t(), remainder.get_mpz_t(), n.get_mpz_t(), 10);
-  CHECK(quotient == BigInt("455343564565433432657768658748777353763737638736767676575375666435745243523452353434355326565465443764565747477773"));
-  CHECK(remainder == BigInt("7"));
+  if (persistence > r.max_persistence
+      || (persistence == r.max_persistence && IsBeforeInChunk(candidate, r.record_holder))) {
+    r.max_persistence = persistence;
+    r.record_holder = candidate;
+  }
 }
 
-TEST_CASE("AllPossibleTripletsWithSum")
-{
-  std::vector<std::array<int, 3>> triplets4;
-  for (auto v: AllPossibleTripletsWithSum(4))
-    triplets4.push_back(v);
+// Zero-digit filter: the first product of a candidate is 2^exp2.3^exp3.7^exp7 (and a candidate
+// is the only one with these exponents, see DigitCounts). If this product has a zero digit,
+// the persistence is 2. This is checked first on its lowest digits, which are computed
+// from tables of 2^i, 3^i and 7^i modulo 10^19 (and then 10^76) without computing the product:
+// the product is only computed for the ~0.03% of candidates that pass both checks.
+// The reverse search (see run_reverse_search) uses the same tables, with the powers of 5.
 
-  std::vector<std::array<int, 3>> expected {
+// SmoothExponents : the exponents {a, b, c, d} of the 7-smooth number 2^a.3^b.5^c.7^d
+using SmoothExponents = std::array<int, 4>;
+
+// LowestDigitsModuli : the powers of 2, 3, 5, 7 modulo 10^19 and modulo 10^(19 * kNbCheckedWords),
+// grown as needed (each thread has its own tables)
+constexpr int kNbCheckedWords = 4;
+constexpr int kNbCheckedDigits = kDigitsPerWord * kNbCheckedWords;
+
+struct LowestDigitsModuli
+{
+  std::array<std::vector<unsigned long>, 4> powers_mod_word;
+  std::array<std::vector<BigInt>, 4> powers_mod_words;
+  BigInt modulus_words;
+
+  LowestDigitsModuli()
+  {
+    mpz_ui_pow_ui(modulus_words.get_mpz_t(), 10, kNbCheckedDigits);
+  }
+
+  void Reserve(const SmoothExponents & max_exponents)
+  {
+    static const std::array<unsigned long, 4> primes { 2, 3, 5, 7 };
+    for (int k = 0; k < 4; k++)
+    {
+      auto & mod_word = powers_mod_word[k];
+      auto & mod_words = powers_mod_words[k];
+      while ((int)mod_word.size() <= max_exponents[k])
+      {
+        if (mod_word.empty())
+        {
+          mod_word.push_back(1);
+          mod_words.push_back(BigInt(1));
+          continue;
+        }
+        mod_word.push_back((unsigned long)((NativeUInt)mod_word.back() * primes[k] % kTenPowDigitsPerWord));
+        BigInt next = mod_words.back() * primes[k];
+        mpz_fdiv_r(next.get_mpz_t(), next.get_mpz_t(), modulus_words.get_mpz_t());
+        mod_words.push_back(next);
+      }
+    }
+  }
+
+  // LowestWord : 2^a.3^b.5^c.7^d % 10^19 (the powers 0 are skipped)
+  unsigned long LowestWord(const SmoothExponents & e) const
+  {
+    NativeUInt r = 1;
+    for (int k = 0; k < 4; k++)
+      if (e[k] > 0)
+        r = r * powers_mod_word[k][e[k]] % kTenPowDigitsPerWord;
+    return (unsigned long)r;
+  }
+
+  // LowestWords : 2^a.3^b.5^c.7^d % 10^(19 * kNbCheckedWords)
+  void LowestWords(const SmoothExponents & e, BigInt & r) const
+  {
+    r = 1;
+    for (int k = 0; k < 4; k++)
+      if (e[k] > 0)
+      {
+        r *= powers_mod_words[k][e[k]];
+        mpz_fdiv_r(r.get_mpz_t(), r.get_mpz_t(), modulus_words.get_mpz_t());
+      }
+  }
+};
+
+// SmoothProductHasLowZeroDigit : true if 2^a.3^b.5^c.7^d, a number of nb_digits digits,
+// has a zero digit among its lowest min(nb_digits, kNbCheckedDigits) digits
+inline bool SmoothProductHasLowZeroDigit(const SmoothExponents & e, int nb_digits)
+{
+  thread_local LowestDigitsModuli moduli;
+  thread_local BigInt lowest_words;
+
+  moduli.Reserve(e);
+  if (MultiplyWordDigits(moduli.LowestWord(e), std::min(nb_digits, kDigitsPerWord)) == 0)
+    return true;
+  if (nb_digits <= kDigitsPerWord)
+    return false;
+  moduli.LowestWords(e, lowest_words);
+  for (int i = 0; i < kNbCheckedWords && i * kDigitsPerWord < nb_digits; i++)
+  {
+    unsigned long word = mpz_fdiv_q_ui(lowest_words.get_mpz_t(), lowest_words.get_mpz_t(), kTenPowDigitsPerWord);
+    if (MultiplyWordDigits(word, std::min(nb_digits - i * kDigitsPerWord, kDigitsPerWord)) == 0)
+      return true;
+  }
+  return false;
+}
+
+// FirstProductMinDigits : a lower bound of the number of digits of FirstProduct(c)
+inline double FirstProductMinDigits(const std::array<int, 3> & e)
+{
+  return e[0] * std::log10(2.) + e[1] * std::log10(3.) + e[2] * std::log10(7.) - 1.;
+}
+
+// FirstProductHasLowZeroDigit : true if FirstProduct(c) has a zero digit among its lowest
+// kNbCheckedDigits digits (false if it may have fewer digits: its leading zeros would not count)
+inline bool FirstProductHasLowZeroDigit(const std::array<int, 3> & e)
+{
+  if (FirstProductMinDigits(e) <= kNbCheckedDigits)
+    return false;
+  return SmoothProductHasLowZeroDigit({ e[0], e[1], 0, e[2] }, kNbCheckedDigits);
+}
+
+// ScoreGrayCandidate : updates first_product (see ApplyGraySwap) and adds the candidate to r.
+// A candidate rejected by the zero-digit filter leaves first_product at 0 (never a first product):
+// the next candidate computes its own from scratch
+inline void ScoreGrayCandidate(BigInt & first_product, const GrayCandidate & gray_candidate, ChunkResult & r)
+{
+  const DigitCounts & candidate = gray_candidate.counts;
+  r.nb_candidates++;
+  int root = 0;
+  int persistence = 2;
+  if (candidate.nbDigits() <= 1)
+    persistence = PersistenceValue(candidate, &root);
+  else if (FirstProductHasLowZeroDigit(candidate.primeExponents()))
+    first_product = 0;
+  else
+  {
+    if (mpz_sgn(first_product.get_mpz_t()) == 0)
+      first_product = FirstProduct(candidate);
+    else
+      ApplyGraySwap(first_product, gray_candidate);
+    persistence = 1 + PersistenceValue(first_product, &root);
+  }
+  TestOneNumber(persistence);
+  AddCandidateResult(r, candidate, persistence);
+  r.distribution.add(persistence, root);
+}
+
+// process_chunk : the candidates are walked in the Gray order, so that their first product
+// is updated incrementally. In case of a tie, the record holder is the first candidate
+// in the candidates order (as with candidateDigitCountsInChunk)
+ChunkResult process_chunk(const CandidateChunk & chunk)
+{
+  thread_cpu_stopwatch cpu_timer;
+  ChunkResult r;
+  thread_local BigInt first_product;
+  TraceSampler sampler(chunk.nb_digits);
+  for (const auto & gray_candidate: candidateDigitCountsInChunk_Gray(chunk))
+  {
+    sampler.begin_candidate();
+    ScoreGrayCandidate(first_product, gray_candidate, r);
+    sampler.end_candidate();
+  }
+  r.cpu_time = cpu_timer.elapsed();
+  return r;
+}
+
+// process_chunk_lexicographic : reference version of process_chunk, with the first product
+// of each candidate computed from scratch
+ChunkResult process_chunk_lexicographic(const CandidateChunk & chunk)
+{
+  thread_cpu_stopwatch cpu_timer;
+  ChunkResult r;
+  for (const auto & candidate: candidateDigitCountsInChunk(chunk))
+  {
+    r.nb_candidates++;
+    int root;
+    int persistence = TestOneNumber(PersistenceValue(candidate, &root));
+    r.distribution.add(persistence, root);
+    if (persistence > r.max_persistence) {
+      r.max_persistence = persistence;
+      r.record_holder = candidate;
+    }
+  }
+  r.cpu_time = cpu_timer.elapsed();
+  return r;
+}
+
+// reduce_chunk_results : chunk_results shall be in the candidates order,
+// so that the record holder is the same as with a sequential search
+ChunkResult reduce_chunk_results(const std::vector<ChunkResult> & chunk_results)
+{
+  ChunkResult r;
+  for (const auto & chunk_result: chunk_results)
+  {
+    r.nb_candidates += chunk_result.nb_candidates;
+    r.cpu_time += chunk_result.cpu_time;
+    r.distribution += chunk_result.distribution;
+    if (chunk_result.max_persistence > r.max_persistence) {
+      r.max_persistence = chunk_result.max_persistence;
+      r.record_holder = chunk_result.record_holder;
+    }
+  }
+  return r;
+}
+
+// RecordLog : logs the records ("New max at ..."), in the ascending order of the digit counts.
+// The digit counts are not completed in this order (see ScheduleLongestFirst): the result of a digit count
+// of the search is held until the smaller ones are completed, so that each logged record holder
+// is the smallest number with its persistence
+class RecordLog
+{
+public:
+  struct Record
+  {
+    int nb_digits;
+    int persistence;
+    std::string record_holder;
+  };
+
+  // start : the digit counts of the search (the other ones are logged when they are added)
+  void start(int nb_digits_min, int nb_digits_max)
+  {
+    std::lock_guard lock(mutex_);
+    next_nb_digits_ = nb_digits_min;
+    nb_digits_max_ = nb_digits_max;
+    pending_.clear();
+  }
+
+  // add : the result of a completed digit count
+  void add(int nb_digits, int persistence, const std::string & record_holder)
+  {
+    std::lock_guard lock(mutex_);
+    Record record { nb_digits, persistence, record_holder };
+    if (nb_digits < next_nb_digits_ || nb_digits > nb_digits_max_)
+    {
+      log_locked(record);
+      return;
+    }
+    pending_[nb_digits] = std::move(record);
+    for (auto it = pending_.begin(); it != pending_.end() && it->first == next_nb_digits_; it = pending_.erase(it))
+    {
+      log_locked(it->second);
+      next_nb_digits_++;
+    }
+  }
+
+  // records : the records logged so far
+  std::vector<Record> records()
+  {
+    std::lock_guard lock(mutex_);
+    return records_;
+  }
+
+private:
+  void log_locked(const Record & record)
+  {
+    if (record.persistence <= max_persistence_)
+      return;
+    max_persistence_ = record.persistence;
+    records_.push_back(record);
+    spdlog::warn("New max at {} with persistence={}", record.record_holder, record.persistence);
+  }
+
+  std::mutex mutex_;
+  int next_nb_digits_ = 0, nb_digits_max_ = -1; // outside of a search: nothing is held
+  std::map<int, Record> pending_;
+  int max_persistence_ = 0;
+  std::vector<Record> records_;
+};
+
+RecordLog gRecordLog;
+
+void report_nb_digits_result(int nb_digits, const ChunkResult & result, double elapsed)
+{
+  // the decimal form is only built for the record holder
+  BigInt record_holder = DigitCountsToBigInt(result.record_holder);
+  gRecordLog.add(nb_digits, result.max_persistence, record_holder.get_str());
+  spdlog::info("Finished nb_digits={} ({} candidates, each with a distinct first product)\n"
+    "nb_digits,time,max_persistence,where:{},{},{},{}",
+    nb_digits, result.nb_candidates,
+    nb_digits, elapsed, result.max_persistence, record_holder.get_str()
+  );
+  bool conjecture_test = checkConjecture237(record_holder);
+  if (!conjecture_test)
+  {
+    spdlog::warn("Conjecture not verified for nb_digits={} persistence={} for {}\n",
+      nb_digits, result.max_persistence, record_holder.get_str() );
+  }
+}
+
+void process_for_nb_digits(int nb_digits)
+{
+  spdlog::info("Starting nb_digits={}", nb_digits);
+  stopwatch timer;
+  std::vector<ChunkResult> chunk_results;
+  for (const auto & chunk: CandidateChunks(nb_digits))
+    chunk_results.push_back(process_chunk(chunk));
+  report_nb_digits_result(nb_digits, reduce_chunk_results(chunk_results), timer.elapsed());
+}
+
+// Number of candidates per chunk when a digit count is split between the pool threads:
+// small enough so that the last digit counts are shared by all the threads,
+// big enough so that the cost of a chunk dwarfs the cost of posting it
+constexpr long kNbCandidatesPerChunk = 4096;
+
+// Shard : the part of the search done by one of nb_shards independent processes (--shard I/N).
+// The chunk chunk_idx of nb_digits belongs to the shard (nb_digits + chunk_idx) % nb_shards:
+// this does not depend on the searched digit counts, and the big digit counts
+// (which have many chunks) are evenly split.
+struct Shard
+{
+  int index = 0;
+  int nb_shards = 1;
+
+  bool contains(int nb_digits, std::size_t chunk_idx) const
+  {
+    return (nb_digits + chunk_idx) % nb_shards == (std::size_t)index;
+  }
+  bool operator==(const Shard & other) const { return index == other.index && nb_shards == other.nb_shards; }
+  bool operator!=(const Shard & other) const { return !(*this == other); }
+};
+
+// Checkpoint : an append-only file with the completed chunks and digit counts,
+// so that a search can be resumed (--resume) after a crash or a stop.
+// With --shard, it is also the result file of the shard, read by --merge.
+// Its lines are:
+//   chunk_size,<nb_candidates_per_chunk>
+//   shard,<index>,<nb_shards>
+//   chunk,<nb_digits>,<chunk_idx>,<nb_candidates>,<max_persistence>,<nb_2>,<nb_3>,<nb_4>,<nb_7>,<nb_8>,<nb_9>,<cpu_time>,<elapsed>,<distribution>
+// (elapsed : the wall time of the digit count when the chunk was completed, including the previous runs)
+//   nb_digits,<nb_digits>,<elapsed>
+// The file is flushed every kCheckpointFlushPeriod seconds, and when a digit count is completed.
+constexpr double kCheckpointFlushPeriod = 30.;
+
+class Checkpoint
+{
+public:
+  // Results of the previous runs (filled by load)
+  std::map<int, std::map<std::size_t, ChunkResult>> previous_chunk_results;
+  std::map<int, double> previous_nb_digits_elapsed;
+  std::map<int, double> previous_nb_digits_partial_elapsed; // digit counts not completed: the wall time spent on them
+  Shard shard;
+  long chunk_size = 0; // read by load (0 if the file has no chunk_size line)
+  long nb_invalid_lines = 0; // lines ignored by load (incomplete, or written with another format)
+
+  Checkpoint(const std::string & filename, long nb_candidates_per_chunk)
+    : filename_(filename), nb_candidates_per_chunk_(nb_candidates_per_chunk) {}
+  Checkpoint(const std::string & filename, long nb_candidates_per_chunk, const Shard & shard_)
+    : shard(shard_), filename_(filename), nb_candidates_per_chunk_(nb_candidates_per_chunk) {}
+
+  // load : reads the results of the previous runs (and their shard).
+  // Returns false if they were obtained with another chunk size
+  // (the chunk indexes would not match).
+  // A line is only read if it is complete: with all its fields, and ended by a newline
+  // (the last line may be truncated by a crash during a write).
+  // Without a file, there is no previous result (and the shard is unchanged).
+  bool load()
+  {
+    std::ifstream file(filename_);
+    if (!file)
+      return true;
+    shard = Shard();
+    chunk_size = 0;
+    nb_invalid_lines = 0;
+    std::string line;
+    while (std::getline(file, line))
+    {
+      if (file.eof())
+      {
+        nb_invalid_lines++;
+        break;
+      }
+      std::istringstream ss(line);
+      std::string kind;
+      std::getline(ss, kind, ',');
+      char sep;
+      if (kind == "chunk_size")
+      {
+        long line_chunk_size;
+        if (!(ss >> line_chunk_size) || !ss.eof())
+          nb_invalid_lines++;
+        else if (line_chunk_size != nb_candidates_per_chunk_)
+          return false;
+        else
+          chunk_size = line_chunk_size;
+      }
+      else if (kind == "shard")
+      {
+        Shard line_shard;
+        if ((ss >> line_shard.index >> sep >> line_shard.nb_shards) && ss.eof())
+          shard = line_shard;
+        else
+          nb_invalid_lines++;
+      }
+      else if (kind == "chunk")
+      {
+        int nb_digits;
+        std::size_t chunk_idx;
+        ChunkResult r;
+        DigitCounts & c = r.record_holder;
+        double elapsed;
+        std::string distribution;
+        // the last line may be truncated (crash during a write): it is then ignored
+        // (a truncated distribution does not count all the candidates)
+        bool complete = (bool)(ss >> nb_digits >> sep >> chunk_idx >> sep >> r.nb_candidates >> sep >> r.max_persistence
+               >> sep >> c.nb_2 >> sep >> c.nb_3 >> sep >> c.nb_4 >> sep >> c.nb_7 >> sep >> c.nb_8 >> sep >> c.nb_9
+               >> sep >> r.cpu_time >> sep >> elapsed >> sep);
+        std::getline(ss, distribution);
+        if (complete && r.distribution.from_string(distribution) && r.distribution.total() == r.nb_candidates)
+        {
+          previous_chunk_results[nb_digits][chunk_idx] = r;
+          double & partial_elapsed = previous_nb_digits_partial_elapsed[nb_digits];
+          partial_elapsed = std::max(partial_elapsed, elapsed);
+        }
+        else
+          nb_invalid_lines++;
+      }
+      else if (kind == "nb_digits")
+      {
+        int nb_digits;
+        double elapsed;
+        if ((ss >> nb_digits >> sep >> elapsed) && ss.eof())
+          previous_nb_digits_elapsed[nb_digits] = elapsed;
+        else
+          nb_invalid_lines++;
+      }
+      else
+        nb_invalid_lines++;
+    }
+    return true;
+  }
+
+  // open : starts writing, after the previous results if append is true.
+  // An incomplete last line is removed first, so that the next line does not extend it.
+  // The header is written if the file is new or empty
+  void open(bool append)
+  {
+    std::lock_guard lock(mutex_);
+    bool write_header = !append;
+    if (append)
+    {
+      std::string content;
+      {
+        std::ifstream file(filename_, std::ios::binary);
+        content.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+      }
+      std::size_t complete_size = content.rfind('\n') == std::string::npos ? 0 : content.rfind('\n') + 1;
+      if (complete_size < content.size())
+        std::filesystem::resize_file(filename_, complete_size);
+      write_header = (complete_size == 0);
+    }
+    file_.open(filename_, append ? std::ios::app : std::ios::trunc);
+    if (write_header)
+    {
+      file_ << "chunk_size," << nb_candidates_per_chunk_ << "\n";
+      file_ << "shard," << shard.index << "," << shard.nb_shards << "\n";
+    }
+    flush_locked();
+  }
+
+  // elapsed : the wall time of the digit count so far (see previous_nb_digits_partial_elapsed)
+  void add_chunk_result(int nb_digits, std::size_t chunk_idx, const ChunkResult & r, double elapsed = 0.)
+  {
+    std::lock_guard lock(mutex_);
+    const DigitCounts & c = r.record_holder;
+    file_ << "chunk," << nb_digits << "," << chunk_idx << "," << r.nb_candidates << "," << r.max_persistence
+          << "," << c.nb_2 << "," << c.nb_3 << "," << c.nb_4 << "," << c.nb_7 << "," << c.nb_8 << "," << c.nb_9 << "," << r.cpu_time
+          << "," << elapsed << "," << r.distribution.to_string() << "\n";
+    if (since_flush_.elapsed() > kCheckpointFlushPeriod)
+      flush_locked();
+  }
+
+  void add_nb_digits_done(int nb_digits, double elapsed)
+  {
+    std::lock_guard lock(mutex_);
+    file_ << "nb_digits," << nb_digits << "," << elapsed << "\n";
+    flush_locked();
+  }
+
+  void flush()
+  {
+    std::lock_guard lock(mutex_);
+    flush_locked();
+  }
+
+private:
+  void flush_locked()
+  {
+    file_.flush();
+    since_flush_ = stopwatch();
+  }
+
+  std::string filename_;
+  long nb_candidates_per_chunk_;
+  std::mutex mutex_;
+  std::ofstream file_;
+  stopwatch since_flush_;
+};
+
+// MetricsSink : a CSV file with one line per completed digit count, for example in order to fit the cost curve.
+// The CPU time is the sum of the CPU time of the threads that processed the digit count.
+// Each candidate has a distinct first product (see DigitCounts), so nb_distinct_first_products = nb_candidates.
+// The distribution of the persistence of the candidates goes to a second CSV file (if distribution_filename
+// is not empty), with one line per persistence and multiplicative digital root found in a digit count:
+//   nb_digits,persistence,root,nb_candidates
+// The lines are written when a digit count is completed (in any order, see ScheduleLongestFirst),
+// and the distribution file is sorted by finish, so that the files of two searches can be compared with diff
+class MetricsSink
+{
+public:
+  // an empty filename disables the metrics (sharded search: see --merge)
+  MetricsSink(const std::string & filename, bool append, const std::string & distribution_filename = "")
+  {
+    if (filename.empty())
+      return;
+    file_.open(filename, append ? std::ios::app : std::ios::trunc);
+    if (!append)
+      file_ << "nb_digits,wall_time,cpu_time,nb_candidates,nb_distinct_first_products,"
+               "max_persistence,candidates_per_second,record_holder" << std::endl;
+    if (distribution_filename.empty())
+      return;
+    distribution_filename_ = distribution_filename;
+    distribution_file_.open(distribution_filename, append ? std::ios::app : std::ios::trunc);
+    if (!append)
+      distribution_file_ << kDistributionHeader << std::endl;
+  }
+
+  static constexpr const char * kDistributionHeader = "nb_digits,persistence,root,nb_candidates";
+
+  // write_distribution : the lines of a digit count in the distribution file (also used by --merge)
+  static void write_distribution(std::ostream & out, int nb_digits, const PersistenceDistribution & distribution)
+  {
+    const auto & nb_candidates = distribution.nb_candidates;
+    for (int persistence = 0; persistence <= kMaxDistributionPersistence; persistence++)
+      for (int root = 0; root < 10; root++)
+        if (nb_candidates[persistence][root] > 0)
+          out << nb_digits << "," << persistence << "," << root << "," << nb_candidates[persistence][root] << "\n";
+  }
+
+  void add_nb_digits_result(int nb_digits, const ChunkResult & result, double wall_time)
+  {
+    if (!file_.is_open())
+      return;
+    std::string record_holder = DigitCountsToBigInt(result.record_holder).get_str();
+    std::lock_guard lock(mutex_);
+    file_ << nb_digits << "," << wall_time << "," << result.cpu_time << ","
+          << result.nb_candidates << "," << result.nb_candidates << ","
+          << result.max_persistence << "," << result.nb_candidates / wall_time << ","
+          << record_holder << std::endl;
+    if (!distribution_file_.is_open())
+      return;
+    if (result.distribution.total() != result.nb_candidates)
+      spdlog::warn("The persistence distribution of nb_digits={} counts {} candidates instead of {}",
+        nb_digits, result.distribution.total(), result.nb_candidates);
+    write_distribution(distribution_file_, nb_digits, result.distribution);
+    distribution_file_.flush();
+  }
+
+  // finish : sorts the lines of the distribution file by nb_digits (at the end of the search:
+  // until then, a crash keeps the lines of all the completed digit counts)
+  void finish()
+  {
+    std::lock_guard lock(mutex_);
+    if (!distribution_file_.is_open())
+      return;
+    distribution_file_.close();
+    std::ifstream file(distribution_filename_);
+    std::string header, line;
+    std::getline(file, header);
+    std::vector<std::pair<int, std::string>> lines;
+    while (std::getline(file, line))
+      lines.emplace_back(std::atoi(line.c_str()), line);
+    file.close();
+    // the lines of a digit count are already sorted by persistence and root
+    std::stable_sort(lines.begin(), lines.end(), [](const auto & a, const auto & b) { return a.first < b.first; });
+    std::ofstream sorted_file(distribution_filename_, std::ios::trunc);
+    sorted_file << header << "\n";
+    for (const auto & sorted_line: lines)
+      sorted_file << sorted_line.second << "\n";
+  }
+
+private:
+  std::mutex mutex_;
+  std::ofstream file_;
+  std::string distribution_filename_;
+  std::ofstream distribution_file_;
+};
+
+// gStopRequested : set by SIGINT / SIGTERM. The chunks that were not started are then skipped
+std::atomic<bool> gStopRequested(false);
+
+void on_stop_signal(int)
+{
+  gStopRequested = true;
+}
+
+// ChunkProcessor : the function which searches a chunk (process_chunk)
+using ChunkProcessor = ChunkResult (*)(const CandidateChunk &);
+
+void report_shard_nb_digits_result(int nb_digits, const ChunkResult & result, const Shard & shard)
+{
+  spdlog::info("Finished nb_digits={} for shard {}/{} ({} candidates, max_persistence={})",
+    nb_digits, shard.index, shard.nb_shards, result.nb_candidates, result.max_persistence);
+}
+
+// CostModel : the predicted cpu time of a candidate with nb_digits digits, a * nb_digits^b seconds.
+// Most first products have a zero digit, so that this cost grows slowly
+// (the default is close to the measures of process_chunk up to 250 digits)
+struct CostModel
+{
+  double a = 1e-7;
+  double b = 0.25;
+
+  double candidate_cost(int nb_digits) const { return a * std::pow(nb_digits, b); }
+  double chunk_cost(const CandidateChunk & chunk) const { return chunk.nb_candidates() * candidate_cost(chunk.nb_digits); }
+};
+
+// Below this, the cost of a candidate is dominated by the overheads
+constexpr int kCostModelMinDigits = 20;
+
+// FitCostModel : least squares fit of log(cpu_time / nb_candidates) = log(a) + b.log(nb_digits)
+// on the metrics file of a previous run (see MetricsSink). Returns the default model
+// if the file has less than 2 usable digit counts
+CostModel FitCostModel(const std::string & metrics_filename, int * nb_points = nullptr)
+{
+  std::ifstream file(metrics_filename);
+  std::string line;
+  std::getline(file, line); // header
+  double n = 0., sum_x = 0., sum_y = 0., sum_xx = 0., sum_xy = 0.;
+  while (std::getline(file, line))
+  {
+    std::istringstream ss(line);
+    int nb_digits;
+    double wall_time, cpu_time;
+    long nb_candidates;
+    char sep;
+    if (!(ss >> nb_digits >> sep >> wall_time >> sep >> cpu_time >> sep >> nb_candidates))
+      continue;
+    if (nb_digits < kCostModelMinDigits || cpu_time <= 0. || nb_candidates <= 0)
+      continue;
+    double x = std::log((double)nb_digits), y = std::log(cpu_time / nb_candidates);
+    n += 1.;
+    sum_x += x;
+    sum_y += y;
+    sum_xx += x * x;
+    sum_xy += x * y;
+  }
+  if (nb_points)
+    *nb_points = (int)n;
+  CostModel model;
+  double denominator = n * sum_xx - sum_x * sum_x;
+  if (n < 2. || denominator <= 0.)
+    return model;
+  model.b = (n * sum_xy - sum_x * sum_y) / denominator;
+  model.a = std::exp((sum_y - model.b * sum_x) / n);
+  return model;
+}
+
+// kProgressPeriod : period of the progress reports (seconds)
+constexpr double kProgressPeriod = 10.;
+
+// SearchProgress : the candidates done and remaining, reported every kProgressPeriod seconds
+// with an ETA: the predicted cost of the remaining chunks, at the speed observed
+// on the predicted cost of the chunks done so far
+class SearchProgress
+{
+public:
+  explicit SearchProgress(const CostModel & model) : model_(model) {}
+
+  // add_work : adds a chunk to process (before the search starts)
+  void add_work(const CandidateChunk & chunk)
+  {
+    nb_candidates_total_ += chunk.nb_candidates();
+    cost_total_ += model_.chunk_cost(chunk);
+  }
+
+  void on_chunk_done(const CandidateChunk & chunk)
+  {
+    std::lock_guard lock(mutex_);
+    nb_candidates_done_ += chunk.nb_candidates();
+    cost_done_ += model_.chunk_cost(chunk);
+    if (since_report_.elapsed() >= kProgressPeriod)
+    {
+      spdlog::info("Progress: {:.1f}% ({} candidates done, {} remaining), ETA {:.0f}s",
+        100. * cost_done_ / cost_total_, nb_candidates_done_, nb_candidates_total_ - nb_candidates_done_, eta_locked());
+      since_report_ = stopwatch();
+    }
+  }
+
+  double eta()
+  {
+    std::lock_guard lock(mutex_);
+    return eta_locked();
+  }
+
+private:
+  double eta_locked() const
+  {
+    if (cost_done_ <= 0.)
+      return 0.;
+    return timer_.elapsed() * (cost_total_ - cost_done_) / cost_done_;
+  }
+
+  CostModel model_;
+  std::mutex mutex_;
+  long nb_candidates_total_ = 0, nb_candidates_done_ = 0;
+  double cost_total_ = 0., cost_done_ = 0.;
+  stopwatch timer_, since_report_;
+};
+
+// NbDigitsTask : the chunks of a digit count, which are processed in parallel.
+// The last chunk to finish reduces the results and reports them
+// (only the max of the shard when the search is sharded: --merge reports the full results).
+struct NbDigitsTask
+{
+  int nb_digits;
+  std::vector<CandidateChunk> chunks;
+  std::vector<ChunkResult> chunk_results;
+  std::atomic<std::size_t> nb_chunks_remaining;
+  std::once_flag started;
+  stopwatch timer;
+  double previous_elapsed = 0.; // wall time spent on this digit count by the previous runs (--resume)
+  long trace_begin_ns = 0;
+  Checkpoint & checkpoint;
+  MetricsSink & metrics;
+  ChunkProcessor process;
+  bool sharded;
+  SearchProgress * progress = nullptr;
+
+  NbDigitsTask(int nb_digits_, Checkpoint & checkpoint_, MetricsSink & metrics_, ChunkProcessor process_)
+    : nb_digits(nb_digits_)
+    , chunks(CandidateChunks(nb_digits_, kNbCandidatesPerChunk))
+    , chunk_results(chunks.size())
+    , nb_chunks_remaining(chunks.size())
+    , checkpoint(checkpoint_)
+    , metrics(metrics_)
+    , process(process_)
+    , sharded(checkpoint_.shard.nb_shards > 1)
+  {}
+
+  // start : called before processing a chunk
+  void start()
+  {
+    std::call_once(started, [this]() {
+      spdlog::info("Starting nb_digits={}", nb_digits);
+      timer = stopwatch();
+      if (Trace::IsEnabled())
+        trace_begin_ns = Trace::Now();
+    });
+  }
+
+  // elapsed : the wall time of the digit count, including the previous runs
+  double elapsed() const { return previous_elapsed + timer.elapsed(); }
+
+  void complete_chunk(std::size_t chunk_idx, const ChunkResult & result)
+  {
+    chunk_results[chunk_idx] = result;
+    checkpoint.add_chunk_result(nb_digits, chunk_idx, result, elapsed());
+    if (progress)
+      progress->on_chunk_done(chunks[chunk_idx]);
+    on_chunk_done();
+  }
+
+  void on_chunk_done()
+  {
+    if (nb_chunks_remaining.fetch_sub(1) == 1)
+    {
+      double elapsed = this->elapsed();
+      // (a digit count completed during a previous run has not started)
+      if (Trace::IsEnabled() && trace_begin_ns > 0)
+        Trace::Record("nb_digits", trace_begin_ns, Trace::Now(), nb_digits, -1, true);
+      ChunkResult result = reduce_chunk_results(chunk_results);
+      if (sharded)
+        report_shard_nb_digits_result(nb_digits, result, checkpoint.shard);
+      else
+      {
+        report_nb_digits_result(nb_digits, result, elapsed);
+        metrics.add_nb_digits_result(nb_digits, result, elapsed);
+      }
+      checkpoint.add_nb_digits_done(nb_digits, elapsed);
+    }
+  }
+};
+
+// prepare_nb_digits_task : the task of a digit count, and its chunks which remain to be processed
+// (nullptr if the digit count was completed during a previous run: its result is then only reported).
+// The task holds one more count than its chunks to process: release it with on_chunk_done
+// once they are posted (if all the chunks were completed during a previous run,
+// the digit count is reported right there)
+std::shared_ptr<NbDigitsTask> prepare_nb_digits_task(int nb_digits, Checkpoint & checkpoint, MetricsSink & metrics,
+  ChunkProcessor process, std::vector<std::size_t> & chunks_to_process)
+{
+  chunks_to_process.clear();
+  // digit count completed during a previous run: only report its result
+  // (its metrics were written by the previous run)
+  if (checkpoint.previous_nb_digits_elapsed.count(nb_digits))
+  {
+    std::vector<ChunkResult> chunk_results;
+    for (const auto & previous_chunk_result: checkpoint.previous_chunk_results[nb_digits])
+      chunk_results.push_back(previous_chunk_result.second);
+    if (checkpoint.shard.nb_shards > 1)
+      report_shard_nb_digits_result(nb_digits, reduce_chunk_results(chunk_results), checkpoint.shard);
+    else
+      report_nb_digits_result(nb_digits, reduce_chunk_results(chunk_results), checkpoint.previous_nb_digits_elapsed[nb_digits]);
+    return nullptr;
+  }
+
+  auto task = std::make_shared<NbDigitsTask>(nb_digits, checkpoint, metrics, process);
+  if (checkpoint.previous_nb_digits_partial_elapsed.count(nb_digits))
+    task->previous_elapsed = checkpoint.previous_nb_digits_partial_elapsed[nb_digits];
+  for (std::size_t chunk_idx = 0; chunk_idx < task->chunks.size(); chunk_idx++)
+  {
+    auto & previous_chunk_results = checkpoint.previous_chunk_results[nb_digits];
+    if (previous_chunk_results.count(chunk_idx))
+      task->chunk_results[chunk_idx] = previous_chunk_results[chunk_idx];
+    else if (checkpoint.shard.contains(nb_digits, chunk_idx))
+      chunks_to_process.push_back(chunk_idx);
+  }
+  task->nb_chunks_remaining = chunks_to_process.size() + 1;
+  return task;
+}
+
+// ChunkWork : a chunk to process
+struct ChunkWork
+{
+  std::shared_ptr<NbDigitsTask> task;
+  std::size_t chunk_idx;
+
+  const CandidateChunk & chunk() const { return task->chunks[chunk_idx]; }
+};
+
+// prepare_chunks_work : the chunks to process for the digit counts in [nb_digits_min, nb_digits_max],
+// in the ascending order
+std::vector<ChunkWork> prepare_chunks_work(int nb_digits_min, int nb_digits_max, Checkpoint & checkpoint,
+  MetricsSink & metrics, ChunkProcessor process, SearchProgress * progress = nullptr)
+{
+  std::vector<ChunkWork> work;
+  std::vector<std::size_t> chunks_to_process;
+  for (auto nb_digits : numbers_between(nb_digits_min, nb_digits_max + 1))
+  {
+    auto task = prepare_nb_digits_task(nb_digits, checkpoint, metrics, process, chunks_to_process);
+    if (!task)
+      continue;
+    task->progress = progress;
+    for (auto chunk_idx: chunks_to_process)
+    {
+      work.push_back({ task, chunk_idx });
+      if (progress)
+        progress->add_work(task->chunks[chunk_idx]);
+    }
+    // the chunks to process are counted: release the extra count
+    task->on_chunk_done();
+  }
+  return work;
+}
+
+// ScheduleLongestFirst : sorts the digit counts by decreasing predicted cost of their chunks to process,
+// and the chunks of each digit count by decreasing predicted cost (LPT scheduling), so that the most
+// expensive chunks do not start last, while the other threads are idle.
+// The chunks of a digit count stay together, so that its wall time only spans its own chunks
+// (the records are then logged by RecordLog in the order of the digit counts)
+void ScheduleLongestFirst(std::vector<ChunkWork> & work, const CostModel & model)
+{
+  std::map<const NbDigitsTask *, double> task_costs;
+  for (const auto & chunk_work: work)
+    task_costs[chunk_work.task.get()] += model.chunk_cost(chunk_work.chunk());
+  std::stable_sort(work.begin(), work.end(), [&](const ChunkWork & a, const ChunkWork & b) {
+    if (a.task != b.task)
+    {
+      double a_cost = task_costs[a.task.get()], b_cost = task_costs[b.task.get()];
+      return a_cost != b_cost ? a_cost > b_cost : a.task->nb_digits > b.task->nb_digits;
+    }
+    return model.chunk_cost(a.chunk()) > model.chunk_cost(b.chunk());
+  });
+}
+
+// post_chunks : the pool threads share a single queue: an idle thread picks the next chunk
+void post_chunks(boost::asio::thread_pool & pool, const std::vector<ChunkWork> & work)
+{
+  for (const auto & chunk_work : work)
+  {
+    boost::asio::post(pool, [chunk_work]() {
+      if (gStopRequested)
+        return;
+      Trace::NameThread("pool");
+      TraceSpan span("chunk", chunk_work.task->nb_digits, chunk_work.chunk_idx);
+      NbDigitsTask & task = *chunk_work.task;
+      task.start();
+      task.complete_chunk(chunk_work.chunk_idx, task.process(chunk_work.chunk()));
+    });
+  }
+}
+
+// BoundedQueue : a lock-free queue with a fixed capacity (a power of two), for several
+// producers and consumers (D. Vyukov's bounded MPMC queue): each cell holds a sequence number,
+// which tells whether it is ready for the next push or for the next pop.
+// push and pop wait when the queue is full or empty: they spin a little (the wait is usually short),
+// then sleep on a counter of the pops or pushes (std::atomic::wait), so that a stalled thread
+// does not burn a core. The counters are only notified when a thread sleeps on them
+constexpr int kQueueNbSpinsBeforeWait = 64;
+
+template<typename T>
+class BoundedQueue
+{
+public:
+  explicit BoundedQueue(std::size_t capacity)
+    : cells_(new Cell[capacity]), mask_(capacity - 1)
+  {
+    assert((capacity & mask_) == 0);
+    for (std::size_t i = 0; i < capacity; i++)
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  bool try_push(const T & value)
+  {
+    std::size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    for (;;)
+    {
+      Cell & cell = cells_[pos & mask_];
+      std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+      std::ptrdiff_t diff = (std::ptrdiff_t)sequence - (std::ptrdiff_t)pos;
+      if (diff == 0)
+      {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        {
+          cell.value = value;
+          cell.sequence.store(pos + 1, std::memory_order_release);
+          notify(nb_pushes_);
+          return true;
+        }
+      }
+      else if (diff < 0)
+        return false; // full
+      else
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+    }
+  }
+
+  bool try_pop(T & value)
+  {
+    std::size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    for (;;)
+    {
+      Cell & cell = cells_[pos & mask_];
+      std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+      std::ptrdiff_t diff = (std::ptrdiff_t)sequence - (std::ptrdiff_t)(pos + 1);
+      if (diff == 0)
+      {
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        {
+          value = cell.value;
+          cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+          notify(nb_pops_);
+          return true;
+        }
+      }
+      else if (diff < 0)
+        return false; // empty
+      else
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+    }
+  }
+
+  // push : waits for room in the queue
+  void push(const T & value)
+  {
+    wait_until(nb_pops_, [&]() { return try_push(value); });
+  }
+
+  // pop : waits for a value. Returns false if the queue is closed and empty
+  bool pop(T & value)
+  {
+    bool popped = false;
+    wait_until(nb_pushes_, [&]() { return (popped = try_pop(value)) || closed_.load(); });
+    return popped || try_pop(value); // the last values may be pushed before close
+  }
+
+  // close : no more push, the threads waiting in pop return
+  void close()
+  {
+    closed_ = true;
+    nb_pushes_++;
+    nb_pushes_.notify_all();
+  }
+
+  // size : approximate number of values in the queue
+  std::size_t size() const
+  {
+    std::size_t enqueue_pos = enqueue_pos_.load(std::memory_order_relaxed);
+    std::size_t dequeue_pos = dequeue_pos_.load(std::memory_order_relaxed);
+    return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+  }
+
+private:
+  // the counter is read before done(): if it changes before the wait, the wait returns at once
+  template<typename F>
+  void wait_until(std::atomic<unsigned> & counter, F && done)
+  {
+    for (int nb_spins = 0;; nb_spins++)
+    {
+      unsigned seen = counter.load();
+      if (done())
+        return;
+      if (nb_spins < kQueueNbSpinsBeforeWait)
+        std::this_thread::yield();
+      else
+      {
+        nb_waiters_++;
+        counter.wait(seen);
+        nb_waiters_--;
+      }
+    }
+  }
+
+  void notify(std::atomic<unsigned> & counter)
+  {
+    counter++;
+    if (nb_waiters_.load() > 0)
+      counter.notify_all();
+  }
+
+  struct Cell
+  {
+    std::atomic<std::size_t> sequence;
+    T value;
+  };
+  std::unique_ptr<Cell[]> cells_;
+  std::size_t mask_;
+  alignas(64) std::atomic<std::size_t> enqueue_pos_ { 0 };
+  alignas(64) std::atomic<std::size_t> dequeue_pos_ { 0 };
+  alignas(64) std::atomic<unsigned> nb_pushes_ { 0 };
+  alignas(64) std::atomic<unsigned> nb_pops_ { 0 };
+  std::atomic<int> nb_waiters_ { 0 };
+  std::atomic<bool> closed_ { false };
+};
+
+// Pipeline (--pipeline P/S): P producer threads walk the chunks and fill batches of candidates
+// (in the Gray order), which are scored by S scorer threads. The generators state and the GMP
+// numbers are then in different caches, and the memory is bounded by the number of batches.
+constexpr std::size_t kPipelineBatchSize = 256;
+constexpr std::size_t kPipelineQueueCapacity = 64; // batches
+
+// PipelineChunk : a chunk whose batches are being scored. It is completed
+// when its last batch is scored (nb_batches_remaining holds one more count
+// until all its batches are produced)
+struct PipelineChunk
+{
+  std::shared_ptr<NbDigitsTask> task;
+  std::size_t chunk_idx;
+  std::mutex mutex;
+  ChunkResult result;
+  std::atomic<int> nb_batches_remaining { 1 };
+
+  void on_batch_done()
+  {
+    if (nb_batches_remaining.fetch_sub(1) == 1)
+      task->complete_chunk(chunk_idx, result);
+  }
+};
+
+// CandidateBatch : consecutive candidates of a chunk, in the Gray order
+// (the batches are reused: the scorers give them back to the producers)
+struct CandidateBatch
+{
+  std::shared_ptr<PipelineChunk> chunk;
+  std::array<GrayCandidate, kPipelineBatchSize> candidates;
+  std::size_t size = 0;
+};
+
+struct PipelineStats
+{
+  long nb_batches = 0;
+  double queue_depth_sum = 0.; // sampled at each push
+  std::size_t max_queue_depth = 0;
+  double producers_stall_time = 0.; // waiting for a free batch or for room in the queue
+  double scorers_stall_time = 0.;   // waiting for a batch
+
+  double average_queue_depth() const { return nb_batches ? queue_depth_sum / nb_batches : 0.; }
+};
+
+// run_pipeline : processes the chunks of work with nb_producers producers and nb_scorers scorers
+PipelineStats run_pipeline(const std::vector<ChunkWork> & work, int nb_producers, int nb_scorers)
+{
+  BoundedQueue<CandidateBatch *> queue(kPipelineQueueCapacity);
+  // enough batches so that the queue can be full while each thread holds one
+  std::size_t nb_batches = kPipelineQueueCapacity + nb_producers + nb_scorers;
+  std::vector<std::unique_ptr<CandidateBatch>> batches;
+  BoundedQueue<CandidateBatch *> free_batches(std::bit_ceil(nb_batches));
+  for (std::size_t i = 0; i < nb_batches; i++)
+  {
+    batches.push_back(std::make_unique<CandidateBatch>());
+    free_batches.try_push(batches.back().get());
+  }
+
+  std::atomic<std::size_t> next_work(0);
+  std::atomic<int> nb_producers_running(nb_producers);
+  PipelineStats stats;
+  std::mutex stats_mutex;
+
+  auto producer = [&]() {
+    Trace::NameThread("producer");
+    PipelineStats local_stats;
+    auto get_free_batch = [&]() {
+      CandidateBatch * batch;
+      if (!free_batches.try_pop(batch))
+      {
+        TraceSpan span("stall");
+        stopwatch stall;
+        free_batches.pop(batch);
+        local_stats.producers_stall_time += stall.elapsed();
+      }
+      return batch;
+    };
+    auto push_batch = [&](CandidateBatch * batch) {
+      batch->chunk->nb_batches_remaining++;
+      local_stats.nb_batches++;
+      std::size_t depth = queue.size();
+      local_stats.queue_depth_sum += depth;
+      local_stats.max_queue_depth = std::max(local_stats.max_queue_depth, depth);
+      if (!queue.try_push(batch))
+      {
+        TraceSpan span("stall");
+        stopwatch stall;
+        queue.push(batch);
+        local_stats.producers_stall_time += stall.elapsed();
+      }
+    };
+
+    for (std::size_t i = next_work++; i < work.size() && !gStopRequested; i = next_work++)
+    {
+      auto chunk = std::make_shared<PipelineChunk>();
+      chunk->task = work[i].task;
+      chunk->chunk_idx = work[i].chunk_idx;
+      TraceSpan span("produce", chunk->task->nb_digits, chunk->chunk_idx);
+      chunk->task->start();
+      CandidateBatch * batch = nullptr;
+      for (const auto & gray_candidate: candidateDigitCountsInChunk_Gray(chunk->task->chunks[chunk->chunk_idx]))
+      {
+        if (batch == nullptr)
+        {
+          batch = get_free_batch();
+          batch->chunk = chunk;
+          batch->size = 0;
+        }
+        batch->candidates[batch->size++] = gray_candidate;
+        if (batch->size == kPipelineBatchSize)
+        {
+          push_batch(batch);
+          batch = nullptr;
+        }
+      }
+      if (batch != nullptr)
+        push_batch(batch);
+      chunk->on_batch_done();
+    }
+    if (--nb_producers_running == 0)
+      queue.close();
+    std::lock_guard lock(stats_mutex);
+    stats.nb_batches += local_stats.nb_batches;
+    stats.queue_depth_sum += local_stats.queue_depth_sum;
+    stats.max_queue_depth = std::max(stats.max_queue_depth, local_stats.max_queue_depth);
+    stats.producers_stall_time += local_stats.producers_stall_time;
+  };
+
+  auto scorer = [&]() {
+    Trace::NameThread("scorer");
+    double stall_time = 0.;
+    thread_local BigInt first_product;
+    for (;;)
+    {
+      CandidateBatch * batch;
+      if (!queue.try_pop(batch))
+      {
+        TraceSpan span("stall");
+        stopwatch stall;
+        if (!queue.pop(batch))
+          break; // all the producers are done
+        stall_time += stall.elapsed();
+      }
+
+      TraceSpan span("score_batch", batch->chunk->task->nb_digits, batch->chunk->chunk_idx);
+      thread_cpu_stopwatch cpu_timer;
+      ChunkResult r;
+      // the first candidate of a batch has no previous first product
+      GrayCandidate first = batch->candidates[0];
+      first.swap = GraySwap::None;
+      ScoreGrayCandidate(first_product, first, r);
+      for (std::size_t i = 1; i < batch->size; i++)
+        ScoreGrayCandidate(first_product, batch->candidates[i], r);
+      r.cpu_time = cpu_timer.elapsed();
+
+      std::shared_ptr<PipelineChunk> chunk = std::move(batch->chunk);
+      free_batches.try_push(batch);
+      {
+        std::lock_guard lock(chunk->mutex);
+        chunk->result.nb_candidates += r.nb_candidates;
+        chunk->result.cpu_time += r.cpu_time;
+        chunk->result.distribution += r.distribution;
+        AddCandidateResult(chunk->result, r.record_holder, r.max_persistence);
+      }
+      chunk->on_batch_done();
+    }
+    std::lock_guard lock(stats_mutex);
+    stats.scorers_stall_time += stall_time;
+  };
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < nb_producers; i++)
+    threads.emplace_back(producer);
+  for (int i = 0; i < nb_scorers; i++)
+    threads.emplace_back(scorer);
+  for (auto & thread: threads)
+    thread.join();
+  return stats;
+}
+
+///////   Other bases (--base B)
+
+// DigitRules : the digits of the candidates in a base, generalized from the rules of base 10
+// (no 0/1/5/6, at most one 2/3, 4 only without 2, any number of 7/8/9):
+// - the digits are the powers of primes p^k < Base. If Base has several prime factors, the powers
+//   of its biggest prime factor are excluded (with a multiple of the others, the product would end with 0)
+// - the biggest power of each prime is a "free" digit (any number of times), its smaller powers
+//   are "limited": at most one of them in a candidate
+// In base 10, the free digits are 8, 9, 7 and the limited groups are {2, 4} and {3}.
+struct DigitRules
+{
+  static constexpr int kMaxPrimes = 11; // the primes below 36
+  static constexpr int kMaxLimitedPerPrime = 5;
+
+  std::array<int, kMaxPrimes> free_digits {};
+  int nb_free_digits = 0;
+  std::array<std::array<int, kMaxLimitedPerPrime>, kMaxPrimes> limited_digits {};
+  std::array<int, kMaxPrimes> nb_limited_digits {};
+  int nb_limited_groups = 0;
+};
+
+constexpr bool IsPrime(int n)
+{
+  if (n < 2)
+    return false;
+  for (int d = 2; d * d <= n; d++)
+    if (n % d == 0)
+      return false;
+  return true;
+}
+
+template<int Base>
+constexpr DigitRules MakeDigitRules()
+{
+  int excluded_prime = 0, nb_prime_factors = 0;
+  for (int p = 2; p <= Base; p++)
+    if (IsPrime(p) && Base % p == 0)
+    {
+      nb_prime_factors++;
+      excluded_prime = p;
+    }
+  if (nb_prime_factors < 2)
+    excluded_prime = 0;
+
+  DigitRules rules;
+  for (int p = 2; p < Base; p++)
+  {
+    if (!IsPrime(p) || p == excluded_prime)
+      continue;
+    int power = p, nb_limited = 0;
+    while (power * p < Base)
+    {
+      rules.limited_digits[rules.nb_limited_groups][nb_limited++] = power;
+      power *= p;
+    }
+    if (nb_limited > 0)
+      rules.nb_limited_digits[rules.nb_limited_groups++] = nb_limited;
+    rules.free_digits[rules.nb_free_digits++] = power;
+  }
+  return rules;
+}
+
+template<int Base>
+constexpr DigitRules kDigitRules = MakeDigitRules<Base>();
+
+static_assert(kDigitRules<10>.nb_free_digits == 3 && kDigitRules<10>.free_digits[0] == 8
+  && kDigitRules<10>.free_digits[1] == 9 && kDigitRules<10>.free_digits[2] == 7);
+static_assert(kDigitRules<10>.nb_limited_groups == 2 && kDigitRules<10>.nb_limited_digits[0] == 2
+  && kDigitRules<10>.limited_digits[0][1] == 4 && kDigitRules<10>.limited_digits[1][0] == 3);
+
+// BaseDigitCounts : the number of occurrences of each digit of a candidate
+template<int Base>
+using BaseDigitCounts = std::array<int, Base>;
+
+// kNbCandidatesOverflow : the candidates counts that do not fit in a long (big bases or digit counts)
+constexpr long kNbCandidatesOverflow = std::numeric_limits<long>::max();
+
+// Binomial : C(n, k), for the candidates counts (kNbCandidatesOverflow if it does not fit in a long).
+// r.(n - k + i) is computed with 128 bits, so that it is exact before the division
+inline long Binomial(long n, long k)
+{
+  if (k < 0 || k > n)
+    return 0;
+  k = std::min(k, n - k);
+  NativeUInt r = 1;
+  for (long i = 1; i <= k; i++)
+  {
+    r = r * (NativeUInt)(n - k + i) / (NativeUInt)i;
+    if (r >= (NativeUInt)kNbCandidatesOverflow)
+      return kNbCandidatesOverflow;
+  }
+  return (long)r;
+}
+
+// MulAddNbCandidates : nb + a.b, or kNbCandidatesOverflow if it does not fit in a long
+inline long MulAddNbCandidates(long nb, long a, long b)
+{
+  long product;
+  if (nb == kNbCandidatesOverflow || a == kNbCandidatesOverflow || b == kNbCandidatesOverflow
+      || __builtin_mul_overflow(a, b, &product) || __builtin_add_overflow(nb, product, &nb))
+    return kNbCandidatesOverflow;
+  return nb;
+}
+
+// NbCandidates_Base : number of candidates with nb_digits digits in base Base
+// (kNbCandidatesOverflow if it does not fit in a long)
+template<int Base>
+long NbCandidates_Base(int nb_digits)
+{
+  constexpr DigitRules rules = kDigitRules<Base>;
+  // nb_by_nb_limited[k] : number of ways to choose k limited digits
+  std::vector<long> nb_by_nb_limited { 1 };
+  for (int group = 0; group < rules.nb_limited_groups; group++)
+  {
+    std::vector<long> next(nb_by_nb_limited.size() + 1, 0);
+    for (std::size_t k = 0; k < nb_by_nb_limited.size(); k++)
+    {
+      next[k] = MulAddNbCandidates(next[k], nb_by_nb_limited[k], 1);
+      next[k + 1] = MulAddNbCandidates(next[k + 1], nb_by_nb_limited[k], rules.nb_limited_digits[group]);
+    }
+    nb_by_nb_limited = next;
+  }
+  long nb = 0;
+  for (int k = 0; k < (int)nb_by_nb_limited.size() && k <= nb_digits; k++)
+  {
+    int nb_free = nb_digits - k;
+    // the ways to split nb_free digits between the free digits
+    long nb_splits = (rules.nb_free_digits == 0) ? (nb_free == 0) : Binomial(nb_free + rules.nb_free_digits - 1, rules.nb_free_digits - 1);
+    nb = MulAddNbCandidates(nb, nb_by_nb_limited[k], nb_splits);
+  }
+  return nb;
+}
+
+// ForEachCandidate_Base : calls f(counts) for each candidate with nb_digits digits in base Base
+template<int Base, typename F>
+void ForEachCandidate_Base(int nb_digits, F && f)
+{
+  constexpr DigitRules rules = kDigitRules<Base>;
+  BaseDigitCounts<Base> counts {};
+
+  // splits nb_remaining digits between the free digits, from free_idx
+  auto split_free = [&](auto & self, int free_idx, int nb_remaining) -> void {
+    int digit = rules.free_digits[free_idx];
+    if (free_idx == rules.nb_free_digits - 1)
+    {
+      counts[digit] = nb_remaining;
+      f(std::as_const(counts));
+    }
+    else
+      for (int nb = 0; nb <= nb_remaining; nb++)
+      {
+        counts[digit] = nb;
+        self(self, free_idx + 1, nb_remaining - nb);
+      }
+    counts[digit] = 0;
+  };
+
+  // chooses at most one digit in each limited group, from group
+  auto choose_limited = [&](auto & self, int group, int nb_remaining) -> void {
+    if (nb_remaining < 0)
+      return;
+    if (group == rules.nb_limited_groups)
+    {
+      if (rules.nb_free_digits > 0)
+        split_free(split_free, 0, nb_remaining);
+      else if (nb_remaining == 0)
+        f(std::as_const(counts));
+      return;
+    }
+    self(self, group + 1, nb_remaining);
+    for (int i = 0; i < rules.nb_limited_digits[group]; i++)
+    {
+      int digit = rules.limited_digits[group][i];
+      counts[digit] = 1;
+      self(self, group + 1, nb_remaining - 1);
+      counts[digit] = 0;
+    }
+  };
+
+  choose_limited(choose_limited, 0, nb_digits);
+}
+
+// BaseDigitCountsToBigInt : the candidate, with its digits in the ascending order
+template<int Base>
+BigInt BaseDigitCountsToBigInt(const BaseDigitCounts<Base> & counts)
+{
+  static const char * kDigitChars = "0123456789abcdefghijklmnopqrstuvwxyz";
+  std::string digits;
+  for (int digit = 0; digit < Base; digit++)
+    digits.append(counts[digit], kDigitChars[digit]);
+  return BigInt(digits, Base);
+}
+
+// FirstProduct_Base : the product of the digits of the candidate
+template<int Base>
+inline const BigInt & FirstProduct_Base(const BaseDigitCounts<Base> & counts)
+{
+  thread_local BigInt product, power;
+  product = 1;
+  for (int digit = 2; digit < Base; digit++)
+    if (counts[digit] > 0)
+    {
+      mpz_ui_pow_ui(power.get_mpz_t(), digit, counts[digit]);
+      product *= power;
+    }
+  return product;
+}
+
+// IsSmallerCandidate_Base : a < b, for two candidates with the same number of digits
+// (their digits are in the ascending order: the first one with more small digits is the smallest)
+template<int Base>
+inline bool IsSmallerCandidate_Base(const BaseDigitCounts<Base> & a, const BaseDigitCounts<Base> & b)
+{
+  for (int digit = 0; digit < Base; digit++)
+    if (a[digit] != b[digit])
+      return a[digit] > b[digit];
+  return false;
+}
+
+// BaseSearchResult : the result of a digit count in another base
+// (in case of a tie, the record holder is the smallest candidate)
+struct BaseSearchResult
+{
+  int max_persistence = -1;
+  std::string record_holder; // in base Base
+  long nb_candidates = 0;
+  double cpu_time = 0.;
+};
+
+template<int Base>
+BaseSearchResult SearchBase(int nb_digits)
+{
+  thread_cpu_stopwatch cpu_timer;
+  BaseSearchResult r;
+  BaseDigitCounts<Base> record_holder {};
+  ForEachCandidate_Base<Base>(nb_digits, [&](const BaseDigitCounts<Base> & counts) {
+    r.nb_candidates++;
+    int persistence = (nb_digits <= 1)
+      ? PersistenceValue<Base>(BaseDigitCountsToBigInt<Base>(counts))
+      : 1 + PersistenceValue<Base>(FirstProduct_Base<Base>(counts));
+    if (persistence > r.max_persistence
+        || (persistence == r.max_persistence && IsSmallerCandidate_Base<Base>(counts, record_holder)))
+    {
+      r.max_persistence = persistence;
+      record_holder = counts;
+    }
+  });
+  if (r.nb_candidates > 0)
+    r.record_holder = BaseDigitCountsToBigInt<Base>(record_holder).get_str(Base);
+  r.cpu_time = cpu_timer.elapsed();
+  return r;
+}
+
+// kBaseSearches : SearchBase for each base, indexed by the base (nullptr below 2)
+using BaseSearchFunction = BaseSearchResult (*)(int nb_digits);
+
+template<std::size_t... Bases>
+constexpr std::array<BaseSearchFunction, sizeof...(Bases)> MakeBaseSearches(std::index_sequence<Bases...>)
+{
+  return { (Bases >= 2 ? &SearchBase<std::max<int>(Bases, 2)> : nullptr)... };
+}
+
+constexpr int kMaxBase = 36;
+constexpr auto kBaseSearches = MakeBaseSearches(std::make_index_sequence<kMaxBase + 1>());
+
+// run_base_search : the search in another base. The digit counts are processed in parallel,
+// the biggest ones first, and reported in the ascending order at the end
+// (results[i] : the result of nb_digits_min + i)
+void run_base_search(int base, int nb_digits_min, int nb_digits_max, int nb_threads)
+{
+  BaseSearchFunction search = kBaseSearches[base];
+  std::vector<BaseSearchResult> results(nb_digits_max - nb_digits_min + 1);
+  boost::asio::thread_pool pool(nb_threads);
+  for (int nb_digits = nb_digits_max; nb_digits >= nb_digits_min; nb_digits--)
+    boost::asio::post(pool, [&result = results[nb_digits - nb_digits_min], search, nb_digits, base]() {
+      if (gStopRequested)
+        return;
+      Trace::NameThread("pool");
+      TraceSpan span("search_base", nb_digits);
+      result = search(nb_digits);
+      spdlog::info("Finished nb_digits={} in base {} ({} candidates)", nb_digits, base, result.nb_candidates);
+    });
+  pool.join();
+
+  std::cout << "base,nb_digits,max_persistence,nb_candidates,cpu_time,record_holder" << std::endl;
+  int max_persistence = -1;
+  for (int nb_digits = nb_digits_min; nb_digits <= nb_digits_max; nb_digits++)
+  {
+    const BaseSearchResult & r = results[nb_digits - nb_digits_min];
+    if (r.nb_candidates == 0)
+      continue;
+    std::cout << base << "," << nb_digits << "," << r.max_persistence << "," << r.nb_candidates << ","
+              << r.cpu_time << "," << r.record_holder << std::endl;
+    if (r.max_persistence > max_persistence)
+    {
+      max_persistence = r.max_persistence;
+      spdlog::warn("New max at {} (base {}) with persistence={}", r.record_holder, base, max_persistence);
+    }
+  }
+}
+
+// Reverse search (--reverse): instead of the candidates, their first products are enumerated
+// by exponent tuple. The first product of a number with a persistence above 2 has no zero digit:
+// it is 2^a.3^b.7^d, or 3^b.5^c.7^d (c >= 1: with a 5 and an even digit, it ends with 0).
+// For each digit count of the first products, the tuples whose product has a zero digit among
+// its lowest digits are rejected from the tables of LowestDigitsModuli, without computing the product,
+// and the persistence is only computed for the survivors. The searched digit counts are those
+// of the first products: the numbers up to 10^n have first products of at most n.log10(9) digits.
+
+// kLog10SmoothPrimes : log10 of 2, 3, 5, 7
+const std::array<double, 4> kLog10SmoothPrimes { std::log10(2.), std::log10(3.), std::log10(5.), std::log10(7.) };
+
+inline BigInt SmoothProduct(const SmoothExponents & e)
+{
+  static const std::array<unsigned long, 4> primes { 2, 3, 5, 7 };
+  BigInt r = 1, power;
+  for (int k = 0; k < 4; k++)
+  {
+    mpz_ui_pow_ui(power.get_mpz_t(), primes[k], e[k]);
+    r *= power;
+  }
+  return r;
+}
+
+// NbDigitsOfSmoothProduct : the number of digits of 2^a.3^b.5^c.7^d, from its logarithm
+// (the product is computed when the logarithm is too close to an integer to be trusted)
+inline int NbDigitsOfSmoothProduct(const SmoothExponents & e)
+{
+  double l = 0.;
+  for (int k = 0; k < 4; k++)
+    l += e[k] * kLog10SmoothPrimes[k];
+  double floor_l = std::floor(l);
+  if (l - floor_l > 1e-9 && floor_l + 1. - l > 1e-9)
+    return (int)floor_l + 1;
+  return (int)SmoothProduct(e).get_str().size();
+}
+
+// ReversePreimage : the smallest number (of at least 2 digits) with a given first product,
+// as the number of occurrences of each digit
+using ReversePreimage = std::array<int, 10>;
+
+// SmallestPreimage : the digits 9, 8, 7, 6, 5, 4, 3, 2 are taken greedily from the product
+// (this minimizes the number of digits), and then sorted in the ascending order
+inline ReversePreimage SmallestPreimage(const SmoothExponents & e)
+{
+  ReversePreimage p {};
+  int exp2 = e[0] % 3, exp3 = e[1] % 2;
+  p[9] = e[1] / 2;
+  p[8] = e[0] / 3;
+  p[7] = e[3];
+  if (exp2 > 0 && exp3 > 0)
+  {
+    p[6] = 1;
+    exp2--;
+    exp3--;
+  }
+  p[5] = e[2];
+  p[4] = exp2 / 2;
+  p[3] = exp3;
+  p[2] = exp2 % 2;
+  int nb_digits = std::accumulate(p.begin(), p.end(), 0);
+  p[1] = std::max(2 - nb_digits, 0);
+  return p;
+}
+
+// IsSmallerPreimage : compares the numbers (fewer digits, or more small digits at the front)
+inline bool IsSmallerPreimage(const ReversePreimage & a, const ReversePreimage & b)
+{
+  int nb_digits_a = std::accumulate(a.begin(), a.end(), 0), nb_digits_b = std::accumulate(b.begin(), b.end(), 0);
+  if (nb_digits_a != nb_digits_b)
+    return nb_digits_a < nb_digits_b;
+  for (int digit = 1; digit <= 9; digit++)
+    if (a[digit] != b[digit])
+      return a[digit] > b[digit];
+  return false;
+}
+
+inline std::string PreimageToString(const ReversePreimage & p)
+{
+  std::string s;
+  for (int digit = 1; digit <= 9; digit++)
+    s.append(p[digit], (char)('0' + digit));
+  return s;
+}
+
+// ReverseResult : the result of the first products of a digit count (or of a part of them)
+struct ReverseResult
+{
+  long nb_products = 0;
+  long nb_survivors = 0; // the products without a zero digit among their lowest digits
+  int max_persistence = -1;
+  ReversePreimage record_holder {};
+  double cpu_time = 0.;
+
+  void add(int persistence, const ReversePreimage & preimage)
+  {
+    if (persistence > max_persistence || (persistence == max_persistence && IsSmallerPreimage(preimage, record_holder)))
+    {
+      max_persistence = persistence;
+      record_holder = preimage;
+    }
+  }
+
+  void add(const ReverseResult & other)
+  {
+    nb_products += other.nb_products;
+    nb_survivors += other.nb_survivors;
+    cpu_time += other.cpu_time;
+    if (other.max_persistence >= 0)
+      add(other.max_persistence, other.record_holder);
+  }
+};
+
+// ScoreSmoothProduct : the persistence of the smallest preimage of 2^a.3^b.5^c.7^d (a product of nb_digits digits)
+inline void ScoreSmoothProduct(const SmoothExponents & e, int nb_digits, ReverseResult & r)
+{
+  r.nb_products++;
+  int persistence = 2;
+  if (!SmoothProductHasLowZeroDigit(e, nb_digits))
+  {
+    r.nb_survivors++;
+    persistence = 1 + PersistenceValue(SmoothProduct(e));
+  }
+  TestOneNumber(persistence);
+  if (persistence >= r.max_persistence)
+    r.add(persistence, SmallestPreimage(e));
+}
+
+// search_reverse_products : the first products of nb_digits digits with the exponent d for 7
+// (a task of the reverse search). For each exponent of 3, the range of the exponent of 2 (or 5)
+// is found from the logarithms
+ReverseResult search_reverse_products(int nb_digits, int exp7)
+{
+  thread_cpu_stopwatch cpu_timer;
+  ReverseResult r;
+  for (int exp3 = 0; NbDigitsOfSmoothProduct({ 0, exp3, 0, exp7 }) <= nb_digits; exp3++)
+  {
+    double l = exp3 * kLog10SmoothPrimes[1] + exp7 * kLog10SmoothPrimes[3];
+    // 2^a.3^b.7^d, and then 3^b.5^c.7^d
+    for (int k : { 0, 2 })
+    {
+      SmoothExponents e { 0, exp3, 0, exp7 };
+      e[k] = std::max((int)((nb_digits - 1 - l) / kLog10SmoothPrimes[k]) - 1, k == 2 ? 1 : 0);
+      for (;; e[k]++)
+      {
+        int nb_product_digits = NbDigitsOfSmoothProduct(e);
+        if (nb_product_digits > nb_digits)
+          break;
+        if (nb_product_digits == nb_digits)
+          ScoreSmoothProduct(e, nb_digits, r);
+      }
+    }
+  }
+  r.cpu_time = cpu_timer.elapsed();
+  return r;
+}
+
+// MaxExp7 : the biggest exponent of 7 of the first products of nb_digits digits
+inline int MaxExp7(int nb_digits)
+{
+  int exp7 = 0;
+  while (NbDigitsOfSmoothProduct({ 0, 0, 0, exp7 + 1 }) <= nb_digits)
+    exp7++;
+  return exp7;
+}
+
+ReverseResult search_reverse_nb_digits(int nb_digits)
+{
+  ReverseResult r;
+  for (int exp7 = 0, max_exp7 = MaxExp7(nb_digits); exp7 <= max_exp7; exp7++)
+    r.add(search_reverse_products(nb_digits, exp7));
+  return r;
+}
+
+// ReverseNbDigitsTask : the first products of a digit count, searched by one pool task per exponent of 7.
+// The last task of the digit count reports its result
+struct ReverseNbDigitsTask
+{
+  int nb_digits = 0;
+  std::atomic<int> nb_pending_tasks { 0 };
+  std::mutex mutex;
+  ReverseResult result;
+  bool complete = false;
+};
+
+void report_reverse_result(int nb_digits, const ReverseResult & result)
+{
+  std::string record_holder = PreimageToString(result.record_holder);
+  spdlog::info("Finished product_digits={} ({} first products, {} without a zero digit in their lowest digits)\n"
+    "product_digits,cpu_time,max_persistence,where:{},{},{},{}",
+    nb_digits, result.nb_products, result.nb_survivors,
+    nb_digits, result.cpu_time, result.max_persistence, record_holder);
+  if (!checkConjecture237(BigInt(record_holder)))
+  {
+    spdlog::warn("Conjecture not verified for product_digits={} persistence={} for {}\n",
+      nb_digits, result.max_persistence, record_holder);
+  }
+}
+
+// run_reverse_search : the reverse search of the first products of nb_digits_min to nb_digits_max digits,
+// on a thread pool (the biggest digit counts first). Prints the table of the results at the end,
+// and returns them (the digit counts not completed before a stop have complete = false)
+std::vector<std::unique_ptr<ReverseNbDigitsTask>> run_reverse_search(int nb_digits_min, int nb_digits_max, int nb_threads)
+{
+  std::vector<std::unique_ptr<ReverseNbDigitsTask>> tasks;
+  for (int nb_digits = nb_digits_min; nb_digits <= nb_digits_max; nb_digits++)
+  {
+    tasks.push_back(std::make_unique<ReverseNbDigitsTask>());
+    tasks.back()->nb_digits = nb_digits;
+    tasks.back()->nb_pending_tasks = MaxExp7(nb_digits) + 1;
+  }
+  boost::asio::thread_pool pool(nb_threads);
+  for (auto it = tasks.rbegin(); it != tasks.rend(); ++it)
+    for (int exp7 = 0, max_exp7 = MaxExp7((*it)->nb_digits); exp7 <= max_exp7; exp7++)
+      boost::asio::post(pool, [&task = **it, exp7]() {
+        if (gStopRequested)
+          return;
+        Trace::NameThread("pool");
+        TraceSpan span("search_reverse", task.nb_digits, exp7);
+        ReverseResult r = search_reverse_products(task.nb_digits, exp7);
+        {
+          std::lock_guard lock(task.mutex);
+          task.result.add(r);
+        }
+        if (--task.nb_pending_tasks == 0)
+        {
+          task.complete = true;
+          report_reverse_result(task.nb_digits, task.result);
+        }
+      });
+  pool.join();
+
+  std::cout << "product_digits,max_persistence,nb_products,nb_survivors,cpu_time,record_holder,conjecture_237" << std::endl;
+  int max_persistence = -1;
+  for (const auto & task: tasks)
+  {
+    if (!task->complete)
+      continue;
+    const ReverseResult & r = task->result;
+    std::string record_holder = PreimageToString(r.record_holder);
+    std::cout << task->nb_digits << "," << r.max_persistence << "," << r.nb_products << "," << r.nb_survivors << ","
+              << r.cpu_time << "," << record_holder << ","
+              << (checkConjecture237(BigInt(record_holder)) ? "verified" : "not_verified") << std::endl;
+    if (r.max_persistence > max_persistence)
+    {
+      max_persistence = r.max_persistence;
+      spdlog::warn("New max at {} with persistence={}", record_holder, max_persistence);
+    }
+  }
+  return tasks;
+}
+
+// MergedNbDigitsResult : the result of a digit count, merged from the shard files
+struct MergedNbDigitsResult
+{
+  ChunkResult result;
+  std::size_t nb_chunks_done = 0;
+  std::size_t nb_chunks = 0;
+
+  bool complete() const { return nb_chunks_done == nb_chunks; }
+};
+
+// merge_shard_results : merges the chunk results of the shard files.
+// The chunks are reduced in their order: the record holders are those of a single process search.
+// Throws if a file cannot be read, was written with another chunk size, or does not belong
+// to the same search as the first file (another number of shards, the index of another file,
+// or a chunk of another shard)
+std::map<int, MergedNbDigitsResult> merge_shard_results(const std::vector<std::string> & filenames)
+{
+  std::map<int, std::map<std::size_t, ChunkResult>> chunk_results;
+  std::map<int, std::string> shard_filenames; // by shard index
+  int nb_shards = 0;
+  for (const auto & filename: filenames)
+  {
+    if (!std::ifstream(filename))
+      throw std::runtime_error("cannot read " + filename);
+    Checkpoint checkpoint(filename, kNbCandidatesPerChunk);
+    if (!checkpoint.load())
+      throw std::runtime_error(filename + " was written with another chunk size");
+    if (checkpoint.chunk_size != kNbCandidatesPerChunk)
+      throw std::runtime_error(filename + " has no chunk_size line");
+    const Shard & shard = checkpoint.shard;
+    if (nb_shards == 0)
+      nb_shards = shard.nb_shards;
+    if (shard.nb_shards != nb_shards)
+      throw std::runtime_error(fmt::format("{} is a shard of {} shards, {} is a shard of {}",
+        filename, shard.nb_shards, filenames.front(), nb_shards));
+    if (!shard_filenames.emplace(shard.index, filename).second)
+      throw std::runtime_error(fmt::format("{} and {} are both the shard {}/{}",
+        shard_filenames[shard.index], filename, shard.index, nb_shards));
+    for (const auto & [nb_digits, results]: checkpoint.previous_chunk_results)
+      for (const auto & [chunk_idx, result]: results)
+      {
+        if (!shard.contains(nb_digits, chunk_idx))
+          throw std::runtime_error(fmt::format("{} (shard {}/{}) has the chunk {} of nb_digits={}, which belongs to another shard",
+            filename, shard.index, nb_shards, chunk_idx, nb_digits));
+        chunk_results[nb_digits][chunk_idx] = result;
+      }
+  }
+
+  std::map<int, MergedNbDigitsResult> merged;
+  for (const auto & [nb_digits, results]: chunk_results)
+  {
+    MergedNbDigitsResult & m = merged[nb_digits];
+    m.nb_chunks = CandidateChunks(nb_digits, kNbCandidatesPerChunk).size();
+    m.nb_chunks_done = results.size();
+    std::vector<ChunkResult> ordered_results;
+    for (const auto & [chunk_idx, result]: results)
+      ordered_results.push_back(result);
+    m.result = reduce_chunk_results(ordered_results);
+  }
+  return merged;
+}
+
+// merge_shards : prints the table of the merged results (--merge),
+// and writes the distribution of the complete digit counts to distribution_filename (if not empty).
+// Returns the exit code: 1 if a digit count is incomplete
+int merge_shards(const std::vector<std::string> & filenames, const std::string & distribution_filename = "")
+{
+  std::map<int, MergedNbDigitsResult> merged;
+  try
+  {
+    merged = merge_shard_results(filenames);
+  }
+  catch (const std::exception & e)
+  {
+    spdlog::error("Cannot merge: {}", e.what());
+    return 1;
+  }
+
+  std::ofstream distribution_file;
+  if (!distribution_filename.empty())
+  {
+    distribution_file.open(distribution_filename);
+    if (!distribution_file)
+    {
+      spdlog::error("Cannot write the distribution to {}", distribution_filename);
+      return 1;
+    }
+    distribution_file << MetricsSink::kDistributionHeader << "\n";
+  }
+
+  bool all_complete = true;
+  std::cout << "nb_digits,max_persistence,nb_candidates,cpu_time,record_holder,conjecture_237" << std::endl;
+  for (const auto & [nb_digits, m]: merged)
+  {
+    if (!m.complete())
+    {
+      spdlog::warn("nb_digits={} is incomplete: {} of {} chunks", nb_digits, m.nb_chunks_done, m.nb_chunks);
+      all_complete = false;
+      continue;
+    }
+    BigInt record_holder = DigitCountsToBigInt(m.result.record_holder);
+    bool conjecture_test = checkConjecture237(record_holder);
+    std::cout << nb_digits << "," << m.result.max_persistence << "," << m.result.nb_candidates << ","
+              << m.result.cpu_time << "," << record_holder.get_str() << ","
+              << (conjecture_test ? "verified" : "not_verified") << std::endl;
+    if (distribution_file.is_open())
+      MetricsSink::write_distribution(distribution_file, nb_digits, m.result.distribution);
+  }
+  return all_complete ? 0 : 1;
+}
+
+#if defined(ALGO_USE_VECTORS)
+constexpr const char * kAlgoName = "VECTORS";
+#elif defined(ALGO_USE_COROUTINES)
+constexpr const char * kAlgoName = "COROUTINES";
+#elif defined(ALGO_USE_RANGES)
+constexpr const char * kAlgoName = "RANGES";
+#endif
+
+// Options : the command line options (see kUsage)
+struct Options
+{
+  int nb_threads = std::max((int)std::thread::hardware_concurrency(), 1);
+  int nb_digits_min = 4;
+  int nb_digits_max = 99;
+  bool resume = false;
+  bool reverse = false;
+  bool ascending = false;
+  int base = 10;
+  int memo_cache_mb = 0;
+  std::string metrics_filename = "persistence_metrics.csv";
+  std::string distribution_filename = "persistence_distribution.csv";
+  Shard shard;
+  int nb_producers = 0; // --pipeline (0: chunks processed by the thread pool)
+  int nb_scorers = 0;
+  std::vector<std::string> merge_filenames; // --merge
+  std::string trace_filename; // --trace (empty: no trace)
+
+  std::string checkpoint_filename() const
+  {
+    if (shard.nb_shards == 1)
+      return "persistence_checkpoint.csv";
+    return "persistence_shard_" + std::to_string(shard.index) + "_of_" + std::to_string(shard.nb_shards) + ".csv";
+  }
+};
+
+constexpr const char * kUsage =
+  "Usage: persistence [options]\n"
+  "  --threads N      number of pool threads (default: number of hardware threads)\n"
+  "  --min-digits N   first digit count to search, at most --max-digits (default: 4)\n"
+  "  --max-digits N   last digit count to search (default: 99)\n"
+  "  --resume         skip the work saved in persistence_checkpoint.csv\n"
+  "  --reverse        reverse search: enumerate the first products 2^a.3^b.7^d and 3^b.5^c.7^d instead of\n"
+  "                   the candidates; the digit counts are those of the products (no checkpoint, shards\n"
+  "                   nor pipeline); the results are printed at the end\n"
+  "  --ascending      process the digit counts in the ascending order (default: the most expensive chunks first)\n"
+  "  --base B         search in base B (2 to 36, default: 10); the results are printed at the end\n"
+  "  --memo-cache MB  memory cap of the cache of intermediate values, 0 to disable (default: 0)\n"
+  "  --metrics FILE   CSV file with the metrics of each digit count (default: persistence_metrics.csv)\n"
+  "  --distribution FILE  CSV file with the number of candidates by persistence and multiplicative digital root\n"
+  "                   of each digit count (default: persistence_distribution.csv)\n"
+  "  --shard I/N      only search the shard I (0 <= I < N) of N independent processes; its results are\n"
+  "                   written to persistence_shard_I_of_N.csv (no metrics)\n"
+  "  --pipeline P/S   P threads produce batches of candidates, which are scored by S threads\n"
+  "                   (instead of --threads)\n"
+  "  --trace FILE     write the trace of the threads to FILE, in the Chrome trace format\n"
+  "                   (requires a build with PERSISTENCE_TRACE)\n"
+  "  --merge FILE...  merge the results of shard files, print the table of the complete digit counts,\n"
+  "                   and write their distribution (to the --distribution FILE given before --merge)\n"
+  "  --help           display this help\n";
+
+// parse_options : returns false if the search shall not be run
+bool parse_options(int argc, char ** argv, Options & options)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    int * int_option = nullptr;
+    if (arg == "--threads")
+      int_option = &options.nb_threads;
+    else if (arg == "--min-digits")
+      int_option = &options.nb_digits_min;
+    else if (arg == "--memo-cache")
+      int_option = &options.memo_cache_mb;
+    else if (arg == "--base")
+      int_option = &options.base;
+    else if (arg == "--max-digits")
+      int_option = &options.nb_digits_max;
+    else if (arg == "--resume")
+      options.resume = true;
+    else if (arg == "--reverse")
+      options.reverse = true;
+    else if (arg == "--ascending")
+      options.ascending = true;
+    else if (arg == "--metrics" && i + 1 < argc)
+      options.metrics_filename = argv[++i];
+    else if (arg == "--distribution" && i + 1 < argc)
+      options.distribution_filename = argv[++i];
+    else if (arg == "--trace" && i + 1 < argc)
+    {
+      if (!Trace::kCompiled)
+      {
+        std::cerr << "--trace requires a build with PERSISTENCE_TRACE\n";
+        return false;
+      }
+      options.trace_filename = argv[++i];
+    }
+    else if (arg == "--shard" && i + 1 < argc)
+    {
+      std::istringstream ss(argv[++i]);
+      char sep = 0;
+      Shard & shard = options.shard;
+      if (!(ss >> shard.index >> sep >> shard.nb_shards) || sep != '/' || !ss.eof()
+          || shard.nb_shards < 1 || shard.index < 0 || shard.index >= shard.nb_shards)
+      {
+        std::cerr << "Invalid value for --shard\n" << kUsage;
+        return false;
+      }
+    }
+    else if (arg == "--pipeline" && i + 1 < argc)
+    {
+      std::istringstream ss(argv[++i]);
+      char sep = 0;
+      if (!(ss >> options.nb_producers >> sep >> options.nb_scorers) || sep != '/' || !ss.eof()
+          || options.nb_producers < 1 || options.nb_scorers < 1)
+      {
+        std::cerr << "Invalid value for --pipeline\n" << kUsage;
+        return false;
+      }
+    }
+    else if (arg == "--merge" && i + 1 < argc)
+    {
+      options.merge_filenames.assign(argv + i + 1, argv + argc);
+      break;
+    }
+    else
+    {
+      if (arg != "--help")
+        std::cerr << "Unknown option: " << arg << "\n";
+      std::cerr << kUsage;
+      return false;
+    }
+
+    if (int_option)
+    {
+      char * end = nullptr;
+      long value = 0;
+      if (i + 1 < argc)
+        value = std::strtol(argv[i + 1], &end, 10);
+      int min_value = (int_option == &options.memo_cache_mb) ? 0 : (int_option == &options.base) ? 2 : 1;
+      int max_value = (int_option == &options.base) ? kMaxBase : std::numeric_limits<int>::max();
+      if (end == nullptr || *end != '\0' || value < min_value || value > max_value)
+      {
+        std::cerr << "Invalid value for " << arg << "\n" << kUsage;
+        return false;
+      }
+      *int_option = (int)value;
+      i++;
+    }
+  }
+  if (options.nb_digits_min > options.nb_digits_max)
+  {
+    std::cerr << "Invalid digit range: --min-digits " << options.nb_digits_min
+              << " is above --max-digits " << options.nb_digits_max << "\n" << kUsage;
+    return false;
+  }
+  return true;
+}
+
+// write_trace : writes the trace recorded since Trace::Enable (see Trace)
+void write_trace(const std::string & filename)
+{
+  std::ofstream file(filename);
+  Trace::WriteStats stats = Trace::WriteChromeTrace(file);
+  if (!file)
+  {
+    spdlog::error("Cannot write the trace to {}", filename);
+    return;
+  }
+  spdlog::info("Trace: {} events of {} threads written to {} ({} overwritten)",
+    stats.nb_events, stats.nb_threads, filename, stats.nb_overwritten);
+}
+
+#if !defined(UNIT_TEST) && !defined(BENCHMARK)
+int main(int argc, char ** argv)
+{
+  InstallGmpArena();
+  Options options;
+  if (!parse_options(argc, argv, options))
+    return 1;
+  if (!options.merge_filenames.empty())
+    return merge_shards(options.merge_filenames, options.distribution_filename);
+  if (!options.trace_filename.empty())
+  {
+    Trace::Enable();
+    Trace::NameThread("main");
+  }
+  if (options.base != 10)
+  {
+    // the other bases use the generic engine (without checkpoint, shards nor pipeline)
+    spdlog::info("Searching nb_digits in [{}, {}] in base {} with {} threads",
+      options.nb_digits_min, options.nb_digits_max, options.base, options.nb_threads);
+    std::signal(SIGINT, on_stop_signal);
+    std::signal(SIGTERM, on_stop_signal);
+    run_base_search(options.base, options.nb_digits_min, options.nb_digits_max, options.nb_threads);
+    if (!options.trace_filename.empty())
+      write_trace(options.trace_filename);
+    return 0;
+  }
+  if (options.reverse)
+  {
+    // the reverse search has its own engine (without checkpoint, shards nor pipeline)
+    if (options.nb_producers > 0 || options.shard.nb_shards > 1)
+    {
+      spdlog::error("--reverse does not support --pipeline nor --shard");
+      return 1;
+    }
+    spdlog::info("Reverse search of the first products of [{}, {}] digits with {} threads",
+      options.nb_digits_min, options.nb_digits_max, options.nb_threads);
+    std::signal(SIGINT, on_stop_signal);
+    std::signal(SIGTERM, on_stop_signal);
+    run_reverse_search(options.nb_digits_min, options.nb_digits_max, options.nb_threads);
+    if (!options.trace_filename.empty())
+      write_trace(options.trace_filename);
+    return 0;
+  }
+  bool sharded = options.shard.nb_shards > 1;
+  spdlog::info("Searching nb_digits in [{}, {}] with {} (ALGO_USE_{}{})",
+    options.nb_digits_min, options.nb_digits_max,
+    options.nb_producers > 0
+      ? fmt::format("{} producer and {} scorer threads", options.nb_producers, options.nb_scorers)
+      : fmt::format("{} threads", options.nb_threads),
+    kAlgoName,
+    sharded ? fmt::format(", shard {}/{}", options.shard.index, options.shard.nb_shards) : "");
+
+  Checkpoint checkpoint(options.checkpoint_filename(), kNbCandidatesPerChunk, options.shard);
+  if (options.resume)
+  {
+    if (!checkpoint.load())
+    {
+      spdlog::error("Cannot resume: the checkpoint was written with another chunk size");
+      return 1;
+    }
+    if (checkpoint.shard != options.shard)
+    {
+      spdlog::error("Cannot resume: the checkpoint was written for another shard");
+      return 1;
+    }
+    if (checkpoint.nb_invalid_lines > 0)
+      spdlog::warn("{} lines of {} were ignored (incomplete, or written by another version): their chunks are processed again",
+        checkpoint.nb_invalid_lines, options.checkpoint_filename());
+  }
+  checkpoint.open(options.resume);
+  // the cost model is fitted before the metrics file is rewritten
+  int nb_cost_points = 0;
+  CostModel cost_model = FitCostModel(options.metrics_filename, &nb_cost_points);
+  spdlog::info("Cost model: {:.3g} * nb_digits^{:.2f} seconds per candidate ({})", cost_model.a, cost_model.b,
+    nb_cost_points >= 2 ? fmt::format("fitted on {} digit counts of {}", nb_cost_points, options.metrics_filename) : "default");
+  MetricsSink metrics(sharded ? "" : options.metrics_filename, options.resume, options.distribution_filename);
+  std::signal(SIGINT, on_stop_signal);
+  std::signal(SIGTERM, on_stop_signal);
+
+  std::unique_ptr<MemoCache> memo_cache;
+  if (options.memo_cache_mb > 0)
+  {
+    memo_cache = std::make_unique<MemoCache>((std::size_t)options.memo_cache_mb * 1024 * 1024);
+    gMemoCache = memo_cache.get();
+  }
+
+  // Each digit count is split into chunks, so that all the threads stay busy until the end.
+  // The chunks start by the most expensive ones, according to the cost model
+  // fitted on the metrics of the previous run (unless --ascending)
+  SearchProgress progress(cost_model);
+  if (!sharded)
+    gRecordLog.start(options.nb_digits_min, options.nb_digits_max);
+  std::vector<ChunkWork> work = prepare_chunks_work(options.nb_digits_min, options.nb_digits_max, checkpoint, metrics,
+    process_chunk, &progress);
+  if (!options.ascending)
+    ScheduleLongestFirst(work, cost_model);
+
+  if (options.nb_producers > 0)
+  {
+    PipelineStats stats = run_pipeline(work, options.nb_producers, options.nb_scorers);
+    spdlog::info("Pipeline: {} batches, queue depth {:.1f} on average (max {} / {}), "
+      "producers stalled {:.2f}s, scorers stalled {:.2f}s",
+      stats.nb_batches, stats.average_queue_depth(), stats.max_queue_depth, kPipelineQueueCapacity,
+      stats.producers_stall_time, stats.scorers_stall_time);
+  }
+  else
+  {
+    boost::asio::thread_pool pool(options.nb_threads);
+    post_chunks(pool, work);
+    pool.join();
+  }
+
+  checkpoint.flush();
+  metrics.finish();
+  if (gMemoCache)
+  {
+    MemoCache::Stats stats = gMemoCache->GetStats();
+    spdlog::info("Memo cache: {} hits, {} misses, {} values, {} KB",
+      stats.nb_hits, stats.nb_misses, stats.nb_values, stats.memory / 1024);
+  }
+  GmpArena::Stats arena_stats = GmpArena::TotalStats();
+  spdlog::info("GMP arena: {} allocations, {} from malloc, peak {} KB per thread",
+    arena_stats.nb_allocations, arena_stats.nb_mallocs, arena_stats.peak_bytes / 1024);
+#ifdef ALGO_USE_COROUTINES
+  auto frame_stats = conduit::frame_pool::total_stats();
+  spdlog::info("Coroutine frames: {} allocated, {} reused", frame_stats.nb_allocated, frame_stats.nb_reused);
+#endif
+  if (!options.trace_filename.empty())
+    write_trace(options.trace_filename);
+  if (gStopRequested)
+    spdlog::warn("Search stopped: run with --resume in order to continue it");
+}
+
+
+#elif defined(BENCHMARK)
+
+///////   Benchmarks below (persistence_bench)
+// Output: one CSV line per (benchmark, nb_digits)
+//   benchmark,nb_digits,nb_items,ns_per_item,allocs_per_item
+// allocs_per_item counts the calls to operator new and the GMP allocations which reached malloc
+// (all of them with --no-gmp-arena, only those not served by GmpArena otherwise)
+// (and, in COROUTINES mode, the coroutine frames which were not recycled by the frame pool)
+
+std::atomic<long> gNbAllocations(0);
+
+// The replacements are not inlined: the callers see a matched operator new / operator delete
+// pair, and not the malloc / free pair inside them
+__attribute__((noinline)) void * operator new(std::size_t size)
+{
+  gNbAllocations++;
+  if (void * p = std::malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+__attribute__((noinline)) void operator delete(void * p) noexcept { std::free(p); }
+__attribute__((noinline)) void operator delete(void * p, std::size_t) noexcept { std::free(p); }
+
+void * (*gGmpDefaultAlloc)(size_t);
+void * (*gGmpDefaultRealloc)(void *, size_t, size_t);
+void (*gGmpDefaultFree)(void *, size_t);
+
+void InstallGmpAllocationCounters()
+{
+  mp_get_memory_functions(&gGmpDefaultAlloc, &gGmpDefaultRealloc, &gGmpDefaultFree);
+  mp_set_memory_functions(
+    [](size_t size) { gNbAllocations++; return gGmpDefaultAlloc(size); },
+    [](void * p, size_t old_size, size_t new_size) { gNbAllocations++; return gGmpDefaultRealloc(p, old_size, new_size); },
+    [](void * p, size_t size) { gGmpDefaultFree(p, size); });
+}
+
+bool gBenchGmpArena = true;
+
+long NbAllocations()
+{
+  long nb_allocations = gNbAllocations;
+  if (gBenchGmpArena)
+    nb_allocations += GmpArena::Local()->GetStats().nb_mallocs;
+#ifdef ALGO_USE_COROUTINES
+  nb_allocations += (long)conduit::frame_pool::local().stats().nb_allocated;
+#endif
+  return nb_allocations;
+}
+
+// gBenchSink : receives the results of the benchmarked functions, so that they are not optimized away
+volatile long gBenchSink = 0;
+
+// Number of candidates on which the per-candidate benchmarks are run
+constexpr long kNbBenchCandidates = 1000;
+// Above this, candidateNumbersWithNbDigits is too long (and too big in VECTORS mode) to be run fully
+constexpr int kMaxDigitsFullGeneration = 200;
+
+// bench : runs f (which processes nb_items items) and prints its CSV line
+template<typename F>
+void bench(const char * name, int nb_digits, F f)
+{
+  long nb_allocations_before = NbAllocations();
+  stopwatch timer;
+  long nb_items = f();
+  double elapsed = timer.elapsed();
+  long nb_allocations = NbAllocations() - nb_allocations_before;
+  std::cout << name << "," << nb_digits << "," << nb_items << ","
+            << elapsed * 1e9 / nb_items << "," << (double)nb_allocations / nb_items << std::endl;
+}
+
+void bench_nb_digits(int nb_digits)
+{
+  // the first kNbBenchCandidates candidates
+  CandidateChunk first_chunk = CandidateChunks(nb_digits, kNbBenchCandidates).front();
+  std::vector<DigitCounts> candidates;
+  for (const auto & chunk: CandidateChunks(nb_digits, kNbBenchCandidates))
+  {
+    for (const auto & c: candidateDigitCountsInChunk(chunk))
+      if ((long)candidates.size() < kNbBenchCandidates)
+        candidates.push_back(c);
+    if ((long)candidates.size() >= kNbBenchCandidates)
+      break;
+  }
+  std::vector<std::vector<int>> candidates_digits;
+  for (const auto & c: candidates)
+    candidates_digits.push_back(DigitCountsToDigits(c));
+  std::vector<BigInt> candidates_numbers;
+  for (const auto & c: candidates)
+    candidates_numbers.push_back(DigitCountsToBigInt(c));
+
+  bench("AllPossibleTripletsWithSum", nb_digits, [&]() {
+    long nb_triplets = 0;
+    for (const auto & triplet: AllPossibleTripletsWithSum(nb_digits))
+    {
+      nb_triplets++;
+      gBenchSink = gBenchSink + triplet[0];
+    }
+    return nb_triplets;
+  });
+
+  if (nb_digits <= kMaxDigitsFullGeneration)
+    bench("candidateNumbersWithNbDigits", nb_digits, [&]() {
+      long nb_candidates = 0;
+      for (const auto & n: candidateNumbersWithNbDigits(nb_digits))
+      {
+        nb_candidates++;
+        gBenchSink = gBenchSink + mpz_sgn(n.get_mpz_t());
+      }
+      return nb_candidates;
+    });
+
+  // a fixed slice in the middle of the candidates, without generating the previous ones
+  bench("candidateDigitCountsInRange", nb_digits, [&]() {
+    long index_begin = NbCandidatesWithNbDigits(nb_digits) / 2;
+    long nb_candidates = 0;
+    for (const auto & c: candidateDigitCountsInRange(nb_digits, index_begin, index_begin + kNbBenchCandidates))
+    {
+      nb_candidates++;
+      gBenchSink = gBenchSink + c.nb_8;
+    }
+    return nb_candidates;
+  });
+
+  bench("DigitsToBigInt", nb_digits, [&]() {
+    for (const auto & digits: candidates_digits)
+      gBenchSink = gBenchSink + mpz_sgn(DigitsToBigInt(digits).get_mpz_t());
+    return (long)candidates_digits.size();
+  });
+
+  bench("FirstProduct", nb_digits, [&]() {
+    for (const auto & c: candidates)
+      gBenchSink = gBenchSink + mpz_sgn(FirstProduct(c).get_mpz_t());
+    return (long)candidates.size();
+  });
+
+  // OneTransform on the decimal candidates: they have no zero digit, this is its worst case
+  bench("OneTransform", nb_digits, [&]() {
+    for (const auto & n: candidates_numbers)
+      gBenchSink = gBenchSink + mpz_sgn(OneTransform(n).get_mpz_t());
+    return (long)candidates_numbers.size();
+  });
+
+  bench("process_chunk_lexicographic", nb_digits, [&]() {
+    return process_chunk_lexicographic(first_chunk).nb_candidates;
+  });
+
+  // the tables of powers modulo 10^19 and 10^76 of the zero-digit filter are built before
+  process_chunk(first_chunk);
+  bench("process_chunk", nb_digits, [&]() {
+    return process_chunk(first_chunk).nb_candidates;
+  });
+
+  // the first products of nb_digits digits without a 7 (a task of the reverse search)
+  bench("search_reverse_products", nb_digits, [&]() {
+    return search_reverse_products(nb_digits, 0).nb_products;
+  });
+
+
+  bench("PersistenceValue", nb_digits, [&]() {
+    for (const auto & c: candidates)
+      gBenchSink = gBenchSink + PersistenceValue(c);
+    return (long)candidates.size();
+  });
+}
+
+// bench_base : the engine of the other bases, on numbers without any zero digit,
+// and on the candidates of a digit count (in base 10, to be compared with the base 10 engine)
+template<int Base>
+void bench_base(int nb_digits)
+{
+  std::string name_suffix = "_Base" + std::to_string(Base);
+  std::mt19937 random_engine(42);
+  std::vector<BigInt> numbers;
+  for (long i = 0; i < kNbBenchCandidates; i++)
+  {
+    std::string v;
+    for (int j = 0; j < nb_digits; j++)
+      v += "123456789abcdefghijklmnopqrstuvwxyz"[random_engine() % (Base - 1)];
+    numbers.push_back(BigInt(v, Base));
+  }
+  bench(("OneTransform" + name_suffix).c_str(), nb_digits, [&]() {
+    for (const auto & n: numbers)
+      gBenchSink = gBenchSink + mpz_sgn(OneTransform<Base>(n).get_mpz_t());
+    return (long)numbers.size();
+  });
+  bench(("PersistenceValue" + name_suffix).c_str(), nb_digits, [&]() {
+    for (const auto & n: numbers)
+      gBenchSink = gBenchSink + PersistenceValue<Base>(n);
+    return (long)numbers.size();
+  });
+  if (NbCandidates_Base<Base>(nb_digits) <= 200000)
+    bench(("SearchBase" + name_suffix).c_str(), nb_digits, [&]() {
+      BaseSearchResult r = SearchBase<Base>(nb_digits);
+      gBenchSink = gBenchSink + r.max_persistence;
+      return r.nb_candidates;
+    });
+}
+
+// bench_one_transform_big : OneTransform_Words vs OneTransform_Histogram on numbers
+// without any zero digit (the worst case for both)
+void bench_one_transform_big(int nb_digits)
+{
+  std::mt19937 random_engine(42);
+  std::vector<BigInt> numbers;
+  for (int i = 0; i < 3; i++)
+  {
+    std::string v;
+    for (int j = 0; j < nb_digits; j++)
+      v += (char)('1' + random_engine() % 9);
+    numbers.push_back(BigInt(v));
+  }
+  bench("OneTransform_Words", nb_digits, [&]() {
+    for (const auto & n: numbers)
+      gBenchSink = gBenchSink + mpz_sgn(OneTransform_Words(n).get_mpz_t());
+    return (long)numbers.size();
+  });
+  bench("OneTransform_Histogram", nb_digits, [&]() {
+    for (const auto & n: numbers)
+      gBenchSink = gBenchSink + mpz_sgn(OneTransform_Histogram(n).get_mpz_t());
+    return (long)numbers.size();
+  });
+}
+
+// Usage: persistence_bench [--no-gmp-arena] [nb_digits...] (default: a sweep from 50 to 2000)
+// stdout only receives the CSV lines: the logs and the allocators stats go to stderr
+int main(int argc, char ** argv)
+{
+  spdlog::set_default_logger(spdlog::stderr_color_mt("persistence_bench"));
+  int first_arg = 1;
+  if (argc > 1 && std::string(argv[1]) == "--no-gmp-arena")
+  {
+    gBenchGmpArena = false;
+    first_arg = 2;
+  }
+  if (gBenchGmpArena)
+    InstallGmpArena();
+  else
+    InstallGmpAllocationCounters();
+  std::vector<int> all_nb_digits { 50, 100, 200, 500, 1000, 2000 };
+  if (argc > first_arg)
+  {
+    all_nb_digits.clear();
+    for (int i = first_arg; i < argc; i++)
+    {
+      char * end = nullptr;
+      long nb_digits = std::strtol(argv[i], &end, 10);
+      if (*end != '\0' || nb_digits < 1 || nb_digits > std::numeric_limits<int>::max())
+      {
+        std::cerr << "Invalid number of digits: " << argv[i] << "\n"
+                  << "Usage: persistence_bench [--no-gmp-arena] [nb_digits...]" << std::endl;
+        return 1;
+      }
+      all_nb_digits.push_back((int)nb_digits);
+    }
+  }
+  std::cout << "benchmark,nb_digits,nb_items,ns_per_item,allocs_per_item" << std::endl;
+  for (auto nb_digits: all_nb_digits)
+    bench_nb_digits(nb_digits);
+  if (argc == first_arg)
+    for (auto nb_digits: { 1000, 2000, 5000, 10000, 100000 })
+      bench_one_transform_big(nb_digits);
+  if (argc == first_arg)
+    for (auto nb_digits: { 50, 200 })
+    {
+      bench_base<3>(nb_digits);
+      bench_base<10>(nb_digits);
+      bench_base<16>(nb_digits);
+      bench_base<36>(nb_digits);
+    }
+  if (gBenchGmpArena)
+  {
+    GmpArena::Stats arena_stats = GmpArena::Local()->GetStats();
+    std::cerr << "# GMP arena: " << arena_stats.nb_allocations << " allocations, "
+              << arena_stats.nb_mallocs << " from malloc, peak " << arena_stats.peak_bytes / 1024 << " KB" << std::endl;
+  }
+#ifdef ALGO_USE_COROUTINES
+  auto frame_stats = conduit::frame_pool::local().stats();
+  std::cerr << "# coroutine frames: " << frame_stats.nb_allocated << " allocated, "
+            << frame_stats.nb_reused << " reused" << std::endl;
+#endif
+}
+
+#else
+
+///////   Unit Tests below
+TEST_CASE("Playground")
+{
+  // std::cout << PersistenceValue(BigInt("277777788888899")).get_str() << std::endl;
+  // return 0;
+
+  // for (auto v: candidateNumbersWithNbDigits(3))
+  //   std::cout << v.get_str()<< "\n";
+
+  // for (auto v: AllPossibleTripletsWithSum(4))
+  //   std::cout << v[0] << "," << v[1] << "," << v[2] << "\n";
+}
+
+TEST_CASE("BigInt divide & remainder by ten")
+{
+  BigInt n("4553435645654334326577686587487773537637376387367676765753756664357452435234523534343553265654654437645657474777737"), d(10);
+  BigInt quotient(0), remainder(0);
+  mpz_fdiv_qr_ui (quotient.get_mpz_t(), remainder.get_mpz_t(), n.get_mpz_t(), 10);
+  CHECK(quotient == BigInt("455343564565433432657768658748777353763737638736767676575375666435745243523452353434355326565465443764565747477773"));
+  CHECK(remainder == BigInt("7"));
+}
+
+TEST_CASE("AllPossibleTripletsWithSum")
+{
+  std::vector<std::array<int, 3>> triplets4;
+  for (auto v: AllPossibleTripletsWithSum(4))
+    triplets4.push_back(v);
+
+  std::vector<std::array<int, 3>> expected {
     { 0,0,4 },
     { 0,1,3 },
     { 0,2,2 },
@@ -411,53 +4116,1167 @@ TEST_CASE("AllPossibleTripletsWithSum")
     { 3,1,0 },
     { 4,0,0 }
   };
-  bool are_equal = (expected == triplets4);
-  CHECK(are_equal);
+  bool are_equal = (expected == triplets4);
+  CHECK(are_equal);
+}
+
+TEST_CASE("candidateNumbersWithNbDigits")
+{
+  std::vector<BigInt> candidates_3digits;
+  for (auto v: candidateNumbersWithNbDigits(3))
+    candidates_3digits.push_back(v);
+  std::vector<BigInt> expected {
+    237,
+    238,
+    239,
+    347,
+    348,
+    349,
+    377,
+    378,
+    388,
+    379,
+    389,
+    399,
+    277,
+    278,
+    288,
+    279,
+    289,
+    299,
+    477,
+    478,
+    488,
+    479,
+    489,
+    499,
+    777,
+    778,
+    788,
+    888,
+    779,
+    789,
+    889,
+    799,
+    899,
+    999
+  };
+  bool are_equal = (expected == candidates_3digits);
+  CHECK(are_equal);
+}
+
+// Reference implementation: one division by 10 per digit
+BigInt OneTransform_DigitByDigit(BigInt digits, unsigned long base = 10)
+{
+  BigInt multiplied_digits(1), last_digit;
+  while(digits > 0)
+  {
+    mpz_fdiv_qr_ui(digits.get_mpz_t(), last_digit.get_mpz_t(), digits.get_mpz_t(), base);
+    multiplied_digits = multiplied_digits * last_digit;
+  }
+  return multiplied_digits;
+}
+
+TEST_CASE("OneTransform")
+{
+  std::vector<std::string> values {
+    "0", "7", "10", "99", "277777788888899",
+    "9999999999999999999", "10000000000000000000", "19999999999999999999",
+    "1000000000000000000099", // zero inside a word
+    "1234567891234567891" "0234567891234567891", // zero at the start of a word
+    "123456789123456789123456789123456789123456789123456789123456789",
+    "4553435645654334326577686587487773537637376387367676765753756664357452435234523534343553265654654437645657474777737"
+  };
+  for (const auto & v: values)
+    CHECK(OneTransform(BigInt(v)) == OneTransform_DigitByDigit(BigInt(v)));
+
+  for (const auto & c: candidateDigitCountsWithNbDigits(30))
+  {
+    BigInt number = DigitCountsToBigInt(c);
+    for (int i = 0; i < 3; i++)
+    {
+      CHECK(OneTransform(number) == OneTransform_DigitByDigit(number));
+      number = OneTransform_DigitByDigit(number);
+    }
+  }
+}
+
+TEST_CASE("Other bases")
+{
+  // the transforms in other bases
+  std::mt19937 random_engine(42);
+  auto check_base = [&](auto base_constant) {
+    constexpr int base = decltype(base_constant)::value;
+    for (int nb_digits: { 1, 5, 30, 60, 200 })
+    {
+      std::string v;
+      for (int i = 0; i < nb_digits; i++)
+        v += "123456789abcdefghijklmnopqrstuvwxyz"[random_engine() % (base - 1)];
+      BigInt number(v, base);
+      CHECK(OneTransform<base>(number) == OneTransform_DigitByDigit(number, base));
+      int persistence = 0;
+      for (BigInt reference = number; reference >= base; reference = OneTransform_DigitByDigit(reference, base))
+        persistence++;
+      CHECK(PersistenceValue<base>(number) == persistence);
+    }
+  };
+  check_base(std::integral_constant<int, 2>());
+  check_base(std::integral_constant<int, 3>());
+  check_base(std::integral_constant<int, 16>());
+  check_base(std::integral_constant<int, 36>());
+  CHECK(BaseWord<2>::kDigitsPerWord == 63);
+  CHECK(BaseWord<16>::kDigitsPerWord == 15);
+
+  // the rules of base 10 give the candidates of the base 10 engine
+  for (int nb_digits = 1; nb_digits <= 40; nb_digits++)
+  {
+    CHECK(NbCandidates_Base<10>(nb_digits) == NbCandidatesWithNbDigits(nb_digits));
+    long nb_candidates = 0;
+    ForEachCandidate_Base<10>(nb_digits, [&](const BaseDigitCounts<10> &) { nb_candidates++; });
+    CHECK(nb_candidates == NbCandidatesWithNbDigits(nb_digits));
+
+    std::vector<ChunkResult> chunk_results;
+    for (const auto & chunk: CandidateChunks(nb_digits))
+      chunk_results.push_back(process_chunk(chunk));
+    CHECK(SearchBase<10>(nb_digits).max_persistence == reduce_chunk_results(chunk_results).max_persistence);
+  }
+  CHECK(SearchBase<10>(15).record_holder == "277777788888899");
+
+  // base 12 = 2^2.3: the powers of 3 are excluded; 2, 4 are limited and 8 is free; 5, 7, 11 are free
+  constexpr DigitRules rules_12 = kDigitRules<12>;
+  CHECK(rules_12.nb_free_digits == 4);
+  CHECK(rules_12.nb_limited_groups == 1);
+  CHECK(rules_12.nb_limited_digits[0] == 2);
+  for (int nb_digits = 1; nb_digits <= 12; nb_digits++)
+  {
+    long nb_candidates = 0;
+    ForEachCandidate_Base<12>(nb_digits, [&](const BaseDigitCounts<12> & counts) {
+      nb_candidates++;
+      CHECK(counts[3] + counts[9] + counts[6] + counts[1] == 0);
+      CHECK(counts[2] + counts[4] <= 1);
+    });
+    CHECK(nb_candidates == NbCandidates_Base<12>(nb_digits));
+  }
+  // base 3: only the digit 2
+  CHECK(NbCandidates_Base<3>(7) == 1);
+
+  // the counts that do not fit in a long
+  CHECK(Binomial(66, 33) == 7219428434016265740L);
+  CHECK(Binomial(67, 33) == kNbCandidatesOverflow);
+  CHECK(Binomial(1000000, 999998) == 499999500000L);
+  CHECK(NbCandidates_Base<36>(100) > 0);
+  CHECK(NbCandidates_Base<36>(100) < kNbCandidatesOverflow);
+  CHECK(NbCandidates_Base<36>(100000) == kNbCandidatesOverflow);
+  CHECK(NbCandidates_Base<10>(1000000) == NbCandidatesWithNbDigits(1000000));
+  CHECK(SearchBase<3>(7).record_holder == "2222222");
+}
+
+TEST_CASE("PersistenceValue_Native")
+{
+  auto PersistenceValue_DigitByDigit = [](BigInt v) {
+    int n = 0;
+    for (; v >= 10; n++)
+      v = OneTransform_DigitByDigit(v);
+    return n;
+  };
+  std::vector<std::string> values {
+    "0", "9", "10", "25", "277777788888899",
+    "18446744073709551615", "18446744073709551616", // 2^64 - 1, 2^64
+    "340282366920938463463374607431768211455", // 2^128 - 1
+    "340282366920938463463374607431768211456", // 2^128
+    "99999999999999999999999999999999999999", // 38 nines
+    "277777777777777777777777777777777777799", // 39 digits, no zero
+    "1000000000000000000099"
+  };
+  for (const auto & v: values)
+  {
+    BigInt number(v);
+    CHECK(PersistenceValue(number) == PersistenceValue_DigitByDigit(number));
+    if (FitsNativeUInt(number))
+      CHECK(OneTransform_Native(BigIntToNativeUInt(number)) == BigIntToNativeUInt(OneTransform(number)));
+  }
+  for (const auto & c: candidateDigitCountsWithNbDigits(25))
+  {
+    BigInt number = DigitCountsToBigInt(c);
+    CHECK(PersistenceValue(number) == PersistenceValue_DigitByDigit(number));
+  }
+}
+
+TEST_CASE("DigitHistogram")
+{
+  std::mt19937 random_engine(42);
+  std::vector<std::string> values { "0", "7", "10", "1" + std::string(3000, '0') + "1" };
+  for (int nb_digits : { 5, 19, 20, 151, 152, 153, 1000, 4321 })
+  {
+    std::string v;
+    for (int i = 0; i < nb_digits; i++)
+      v += (char)('1' + random_engine() % 9);
+    values.push_back(v);
+    // with zeros around the split positions
+    for (std::size_t i = 0; i + 1 < v.size(); i += 37)
+      v[v.size() - 1 - i] = '0';
+    values.push_back(v);
+  }
+  for (const auto & v: values)
+  {
+    DigitHistogram expected {};
+    for (char c: v)
+      expected[c - '0']++;
+    BigInt number(v);
+    bool are_equal = (ComputeDigitHistogram(number) == expected);
+    CHECK(are_equal);
+    if (number > 0)
+      CHECK(ProductOfDigits(expected) == OneTransform_DigitByDigit(number));
+  }
+
+  // above kHistogramMinDigits, OneTransform uses the histogram
+  BigInt big_number(std::string(kHistogramMinDigits + 100, '7') + "3");
+  CHECK(OneTransform(big_number) == OneTransform_DigitByDigit(big_number));
+  CHECK(OneTransform(big_number * 100 + 2) == 0); // zero inside the last word
+  BigInt big_number_with_zero(std::string(kHistogramMinDigits + 100, '7') + "0" + std::string(200, '3'));
+  CHECK(OneTransform(big_number_with_zero) == 0);
+}
+
+#ifdef ALGO_USE_COROUTINES
+TEST_CASE("Coroutine frame pool")
+{
+  auto count_triplets = []() {
+    int nb = 0;
+    for ([[maybe_unused]] auto v: AllPossibleTripletsWithSum(10))
+      nb++;
+    return nb;
+  };
+  CHECK(count_triplets() == 66);
+  auto stats_before = conduit::frame_pool::local().stats();
+  CHECK(count_triplets() == 66);
+  auto stats_after = conduit::frame_pool::local().stats();
+  // the second run only uses recycled frames
+  CHECK(stats_after.nb_allocated == stats_before.nb_allocated);
+  CHECK(stats_after.nb_reused > stats_before.nb_reused);
+}
+#endif
+
+TEST_CASE("GmpArena")
+{
+  CHECK(GmpArena::SizeClass(1) == GmpArena::kMinSizeClass);
+  CHECK(GmpArena::SizeClass(64) == 6);
+  CHECK(GmpArena::SizeClass(65) == 7);
+
+  GmpArena & arena = *GmpArena::Local();
+  GmpArena::Stats stats_before = arena.GetStats();
+  void * p = arena.Allocate(100);
+  std::memset(p, 1, 100);
+  p = arena.Reallocate(p, 100, 120);  // same size class: the block is kept
+  p = arena.Reallocate(p, 120, 300);
+  CHECK(((unsigned char *)p)[99] == 1);
+  arena.Free(p, 300);
+  // the freed block is reused
+  void * p2 = arena.Allocate(260);
+  CHECK(p2 == p);
+  arena.Free(p2, 260);
+  GmpArena::Stats stats_after = arena.GetStats();
+  CHECK(stats_after.nb_allocations - stats_before.nb_allocations == 4);
+  CHECK(stats_after.bytes == stats_before.bytes);
+  CHECK(stats_after.peak_bytes >= stats_before.bytes + 512);
+}
+
+TEST_CASE("MemoCache")
+{
+  BigInt big_value("277777777777777777777777777777777777777777777777777777777777778888888888999999");
+  {
+    MemoCache cache(1024 * 1024);
+    int persistence = 0;
+    int root = -1;
+    CHECK(!cache.Find(big_value, persistence, root));
+    cache.Insert(big_value, 3, 8);
+    CHECK(cache.Find(big_value, persistence, root));
+    CHECK(persistence == 3);
+    CHECK(root == 8);
+    MemoCache::Stats stats = cache.GetStats();
+    CHECK(stats.nb_hits == 1);
+    CHECK(stats.nb_misses == 1);
+    CHECK(stats.nb_values == 1);
+  }
+  {
+    // no room in the shards
+    MemoCache cache(0);
+    int persistence = 0, root = 0;
+    cache.Insert(big_value, 3, 8);
+    CHECK(!cache.Find(big_value, persistence, root));
+  }
+  {
+    std::vector<DigitCounts> candidates;
+    std::vector<int> persistences;
+    for (const auto & c: candidateDigitCountsWithNbDigits(100))
+    {
+      candidates.push_back(c);
+      persistences.push_back(PersistenceValue(c));
+    }
+    MemoCache cache(1024 * 1024);
+    gMemoCache = &cache;
+    for (int i = 0; i < 2; i++)
+      for (size_t k = 0; k < candidates.size(); k++)
+        CHECK(PersistenceValue(candidates[k]) == persistences[k]);
+    gMemoCache = nullptr;
+  }
+}
+
+TEST_CASE("Persistence distribution")
+{
+  auto Root_DigitByDigit = [](BigInt v) {
+    while (v >= 10)
+      v = OneTransform_DigitByDigit(v);
+    return (int)v.get_ui();
+  };
+  std::vector<std::string> values { "0", "7", "39", "277777788888899", "99999999999999999999999999999999999999",
+                                    "3" + std::string(150, '7') + "9", std::string(200, '9') };
+  for (const auto & value: values)
+  {
+    BigInt number(value);
+    int root = -1;
+    CHECK(PersistenceValue(number, &root) == PersistenceValue(number));
+    CHECK(root == Root_DigitByDigit(number));
+  }
+  int root = -1;
+  CHECK(PersistenceValue(BigInt(39), &root) == 3);
+  CHECK(root == 4);
+
+  // the same distribution with the two chunk processors, and with the memo cache
+  for (int nb_digits : { 1, 2, 30, 120 })
+  {
+    PersistenceDistribution total;
+    long nb_candidates = 0;
+    for (const auto & chunk: CandidateChunks(nb_digits, 500))
+    {
+      ChunkResult r = process_chunk(chunk);
+      CHECK(r.distribution.total() == r.nb_candidates);
+      CHECK(r.distribution == process_chunk_lexicographic(chunk).distribution);
+      MemoCache cache(1024 * 1024);
+      gMemoCache = &cache;
+      for (int i = 0; i < 2; i++)
+        CHECK(r.distribution == process_chunk(chunk).distribution);
+      gMemoCache = nullptr;
+      total += r.distribution;
+      nb_candidates += r.nb_candidates;
+    }
+    PersistenceDistribution expected;
+    for (const auto & c: candidateDigitCountsWithNbDigits(nb_digits))
+    {
+      BigInt number = DigitCountsToBigInt(c);
+      expected.add(PersistenceValue(number), Root_DigitByDigit(number));
+    }
+    CHECK(total == expected);
+    CHECK(total.total() == nb_candidates);
+  }
+
+  PersistenceDistribution d;
+  d.add(2, 0);
+  d.add(2, 0);
+  d.add(11, 0);
+  d.add(20, 8);
+  CHECK(d.to_string() == "2:0:2;11:0:1;15:8:1");
+  PersistenceDistribution parsed;
+  CHECK(parsed.from_string(d.to_string()));
+  CHECK(parsed == d);
+  CHECK(parsed.from_string(""));
+  CHECK(parsed.total() == 0);
+  CHECK(!parsed.from_string("2:0"));
+  CHECK(!parsed.from_string("2:10:1"));
+  CHECK(!parsed.from_string("2:0:1;x"));
+
+  // one line per persistence and root in the distribution file
+  std::string metrics_filename = "persistence_metrics_test.csv", distribution_filename = "persistence_distribution_test.csv";
+  {
+    MetricsSink metrics(metrics_filename, false, distribution_filename);
+    ChunkResult r;
+    r.nb_candidates = 4;
+    r.record_holder.nb_7 = 2;
+    r.distribution = d;
+    metrics.add_nb_digits_result(2, r, 1.);
+  }
+  std::ifstream file(distribution_filename);
+  std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  CHECK(content == "nb_digits,persistence,root,nb_candidates\n2,2,0,2\n2,11,0,1\n2,15,8,1\n");
+  std::remove(metrics_filename.c_str());
+  std::remove(distribution_filename.c_str());
 }
 
-TEST_CASE("candidateNumbersWithNbDigits")
+TEST_CASE("DigitCountsToBigInt")
 {
-  std::vector<BigInt> candidates_3digits;
-  for (auto v: candidateNumbersWithNbDigits(3))
-    candidates_3digits.push_back(v);
-  std::vector<BigInt> expected {
-    237,
-    238,
-    239,
-    347,
-    348,
-    349,
-    377,
-    378,
-    388,
-    379,
-    389,
-    399,
-    277,
-    278,
-    288,
-    279,
-    289,
-    299,
-    477,
-    478,
-    488,
-    479,
-    489,
-    499,
-    777,
-    778,
-    788,
-    888,
-    779,
-    789,
-    889,
-    799,
-    899,
-    999
+  // no bound on the number of digits
+  DigitCounts c;
+  c.nb_2 = 1; c.nb_7 = 12000; c.nb_8 = 5000; c.nb_9 = 3;
+  BigInt number = DigitCountsToBigInt(c);
+  CHECK(number.get_str() == "2" + std::string(12000, '7') + std::string(5000, '8') + "999");
+  CHECK(DigitsToBigInt(DigitCountsToDigits(c)) == number);
+}
+
+TEST_CASE("FirstProduct")
+{
+  for (int nb_digits : { 3, 4, 17, 40 })
+    for (const auto & c: candidateDigitCountsWithNbDigits(nb_digits))
+    {
+      BigInt number = DigitCountsToBigInt(c);
+      CHECK(FirstProduct(c) == OneTransform(number));
+      CHECK(PersistenceValue(c) == PersistenceValue(number));
+    }
+}
+
+TEST_CASE("First products are unique")
+{
+  std::set<std::array<int, 3>> all_prime_exponents;
+  std::size_t nb_candidates = 0;
+  for (int nb_digits = 1; nb_digits < 60; nb_digits++)
+    for (const auto & c: candidateDigitCountsWithNbDigits(nb_digits))
+    {
+      all_prime_exponents.insert(c.primeExponents());
+      nb_candidates++;
+    }
+  CHECK(all_prime_exponents.size() == nb_candidates);
+}
+
+TEST_CASE("Gray traversal")
+{
+  for (int nb_digits : { 1, 2, 3, 4, 17, 60 })
+    for (const auto & chunk: CandidateChunks(nb_digits, 30))
+    {
+      std::set<std::array<int, 3>> candidates, gray_candidates;
+      for (const auto & c: candidateDigitCountsInChunk(chunk))
+        candidates.insert(c.primeExponents());
+
+      BigInt first_product;
+      DigitCounts previous;
+      bool is_first = true;
+      for (const auto & gray_candidate: candidateDigitCountsInChunk_Gray(chunk))
+      {
+        const DigitCounts & c = gray_candidate.counts;
+        gray_candidates.insert(c.primeExponents());
+        // a single digit changes
+        CHECK((gray_candidate.swap == GraySwap::None) == is_first);
+        if (!is_first)
+        {
+          int diff_7 = c.nb_7 - previous.nb_7, diff_8 = c.nb_8 - previous.nb_8, diff_9 = c.nb_9 - previous.nb_9;
+          CHECK(std::abs(diff_7) + std::abs(diff_8) + std::abs(diff_9) == 2);
+        }
+        ApplyGraySwap(first_product, gray_candidate);
+        CHECK(first_product == FirstProduct(c));
+        previous = c;
+        is_first = false;
+      }
+      CHECK(candidates == gray_candidates);
+
+      ChunkResult r = process_chunk(chunk), r_lexicographic = process_chunk_lexicographic(chunk);
+      CHECK(r.nb_candidates == r_lexicographic.nb_candidates);
+      CHECK(r.max_persistence == r_lexicographic.max_persistence);
+      CHECK(r.record_holder.primeExponents() == r_lexicographic.record_holder.primeExponents());
+    }
+}
+
+TEST_CASE("Zero-digit filter")
+{
+  for (const auto & c: candidateDigitCountsWithNbDigits(120))
+  {
+    std::string first_product = FirstProduct(c).get_str();
+    bool has_low_zero_digit = first_product.size() > kNbCheckedDigits
+      && first_product.find('0', first_product.size() - kNbCheckedDigits) != std::string::npos;
+    if (FirstProductHasLowZeroDigit(c.primeExponents()))
+      CHECK(has_low_zero_digit);
+    else
+      CHECK((!has_low_zero_digit || FirstProductMinDigits(c.primeExponents()) <= kNbCheckedDigits));
+  }
+
+  for (int nb_digits : { 3, 40, 100, 150 })
+    for (const auto & chunk: CandidateChunks(nb_digits, 500))
+    {
+      ChunkResult r = process_chunk(chunk), r_lexicographic = process_chunk_lexicographic(chunk);
+      CHECK(r.max_persistence == r_lexicographic.max_persistence);
+      CHECK(r.distribution == r_lexicographic.distribution);
+    }
+
+  // above 10000 digits: the rows nb_9 >= m - 40 of each block
+  constexpr int kBigNbDigits = 12000;
+  for (const auto & [nb_2, nb_3, nb_4]: kCandidateBlocks)
+  {
+    int m = kBigNbDigits - nb_2 - nb_3 - nb_4;
+    CandidateChunk chunk { kBigNbDigits, nb_2, nb_3, nb_4, m - 40, m + 1 };
+    ChunkResult r = process_chunk(chunk), r_lexicographic = process_chunk_lexicographic(chunk);
+    CHECK(r.nb_candidates == chunk.nb_candidates());
+    CHECK(r.nb_candidates == r_lexicographic.nb_candidates);
+    CHECK(r.max_persistence == r_lexicographic.max_persistence);
+    CHECK(r.distribution == r_lexicographic.distribution);
+    CHECK(r.record_holder.primeExponents() == r_lexicographic.record_holder.primeExponents());
+    CHECK(mpz_sizeinbase(DigitCountsToBigInt(r.record_holder).get_mpz_t(), 10) == kBigNbDigits);
+  }
+}
+
+TEST_CASE("Reverse search")
+{
+  // the smallest preimages, against the smallest numbers of up to 5 digits with each digit product
+  std::map<long, long> smallest_numbers;
+  for (long n = 10; n < 100000; n++)
+  {
+    long product = 1;
+    for (long m = n; m > 0; m /= 10)
+      product *= m % 10;
+    if (product > 0)
+      smallest_numbers.emplace(product, n);
+  }
+  const std::array<long, 4> primes { 2, 3, 5, 7 };
+  for (const auto & [product, n]: smallest_numbers)
+  {
+    SmoothExponents e {};
+    long p = product;
+    for (int k = 0; k < 4; k++)
+      for (; p % primes[k] == 0; p /= primes[k])
+        e[k]++;
+    CHECK(SmoothProduct(e) == product);
+    CHECK(PreimageToString(SmallestPreimage(e)) == std::to_string(n));
+  }
+
+  // the search of the first products of up to 16 digits, against all the tuples
+  constexpr int kMaxNbDigits = 16;
+  std::map<int, ReverseResult> expected;
+  for (int a = 0; a < 60; a++)
+    for (int b = 0; b < 40; b++)
+      for (int c = 0; c < 25; c++)
+        for (int d = 0; d < 20; d++)
+        {
+          if (a > 0 && c > 0)
+            continue;
+          std::string product = SmoothProduct({ a, b, c, d }).get_str();
+          int nb_digits = (int)product.size();
+          if (nb_digits > kMaxNbDigits)
+            continue;
+          CHECK(NbDigitsOfSmoothProduct({ a, b, c, d }) == nb_digits);
+          ReverseResult & r = expected[nb_digits];
+          r.nb_products++;
+          if (product.find('0') == std::string::npos)
+            r.nb_survivors++;
+          r.add(1 + PersistenceValue(BigInt(product)), SmallestPreimage({ a, b, c, d }));
+        }
+  for (int nb_digits = 1; nb_digits <= kMaxNbDigits; nb_digits++)
+  {
+    ReverseResult r = search_reverse_nb_digits(nb_digits);
+    CHECK(r.nb_products == expected[nb_digits].nb_products);
+    CHECK(r.nb_survivors == expected[nb_digits].nb_survivors);
+    CHECK(r.max_persistence == expected[nb_digits].max_persistence);
+    CHECK(r.record_holder == expected[nb_digits].record_holder);
+  }
+  ReverseResult r13 = search_reverse_nb_digits(13);
+  CHECK(r13.max_persistence == 11);
+  CHECK(PreimageToString(r13.record_holder) == "277777788888899");
+
+  // above kNbCheckedDigits digits: the rejected products have a zero digit
+  for (int exp7 : { 0, 20, 150 })
+  {
+    ReverseResult r = search_reverse_products(150, exp7), r_full;
+    for (int b = 0; b < 320; b++)
+      for (int k : { 0, 2 })
+        for (int x = (k == 2); x < 500; x++)
+        {
+          SmoothExponents e { 0, b, 0, exp7 };
+          e[k] = x;
+          BigInt product = SmoothProduct(e);
+          if (product.get_str().size() != 150)
+            continue;
+          r_full.nb_products++;
+          r_full.add(1 + PersistenceValue(product), SmallestPreimage(e));
+        }
+    CHECK(r.nb_products > 0);
+    CHECK(r.nb_products == r_full.nb_products);
+    CHECK(r.max_persistence == r_full.max_persistence);
+    CHECK(r.record_holder == r_full.record_holder);
+  }
+
+  // on the thread pool
+  auto tasks = run_reverse_search(1, 30, 2);
+  CHECK(tasks.size() == 30);
+  for (const auto & task: tasks)
+  {
+    ReverseResult r = search_reverse_nb_digits(task->nb_digits);
+    CHECK(task->complete);
+    CHECK(task->result.nb_products == r.nb_products);
+    CHECK(task->result.max_persistence == r.max_persistence);
+    CHECK(task->result.record_holder == r.record_holder);
+  }
+}
+
+TEST_CASE("Candidates random access")
+{
+  auto SameDigitCounts = [](const DigitCounts & a, const DigitCounts & b) {
+    return std::array<int, 6> { a.nb_2, a.nb_3, a.nb_4, a.nb_7, a.nb_8, a.nb_9 }
+      == std::array<int, 6> { b.nb_2, b.nb_3, b.nb_4, b.nb_7, b.nb_8, b.nb_9 };
   };
-  bool are_equal = (expected == candidates_3digits);
-  CHECK(are_equal);
+  for (int nb_digits = 1; nb_digits <= 30; nb_digits++)
+  {
+    std::vector<DigitCounts> all;
+    for (const auto & c: candidateDigitCountsWithNbDigits(nb_digits))
+      all.push_back(c);
+    CHECK(NbCandidatesWithNbDigits(nb_digits) == (long)all.size());
+    for (long k = 0; k < (long)all.size(); k++)
+      CHECK(SameDigitCounts(CandidateAt(nb_digits, k), all[k]));
+
+    long nb = (long)all.size();
+    for (auto [k_begin, k_end]: { std::pair<long, long>{0, nb}, {nb / 3, nb / 2 + 1}, {nb - 1, nb}, {2, 2} })
+    {
+      long k = k_begin;
+      for (const auto & c: candidateDigitCountsInRange(nb_digits, k_begin, k_end))
+      {
+        CHECK(SameDigitCounts(c, all[k]));
+        k++;
+      }
+      CHECK(k == k_end);
+    }
+  }
+  // no need to walk the first candidates
+  DigitCounts last = CandidateAt(10000, NbCandidatesWithNbDigits(10000) - 1);
+  CHECK(last.nb_9 == 10000);
+  CHECK_THROWS(CandidateAt(10000, NbCandidatesWithNbDigits(10000)));
+}
+
+TEST_CASE("CandidateChunks")
+{
+  for (int nb_digits : { 1, 3, 4, 17, 100 })
+  {
+    std::vector<std::array<int, 3>> all_candidates, chunked_candidates;
+    for (const auto & c: candidateDigitCountsWithNbDigits(nb_digits))
+      all_candidates.push_back(c.primeExponents());
+    for (const auto & chunk: CandidateChunks(nb_digits, 50))
+      for (const auto & c: candidateDigitCountsInChunk(chunk))
+        chunked_candidates.push_back(c.primeExponents());
+    bool are_equal = (all_candidates == chunked_candidates);
+    CHECK(are_equal);
+  }
+}
+
+TEST_CASE("TestOneNumber record")
+{
+  // 277777788888899, tested concurrently by several threads
+  DigitCounts c;
+  c.nb_2 = 1; c.nb_7 = 6; c.nb_8 = 6; c.nb_9 = 2;
+  std::vector<std::future<int>> persistences;
+  for (int i = 0; i < 8; i++)
+    persistences.push_back(std::async(std::launch::async, [c]() { return TestOneNumber(c); }));
+  for (auto & p: persistences)
+    CHECK(p.get() == 11);
+  CHECK(gCurrentMaxPersistence.load() == 11);
+  // a smaller persistence does not lower the record
+  CHECK(TestOneNumber(5) == 5);
+  CHECK(gCurrentMaxPersistence.load() == 11);
+}
+
+TEST_CASE("RecordLog")
+{
+  auto nb_digits_of = [](const std::vector<RecordLog::Record> & records) {
+    std::vector<int> v;
+    for (const auto & r: records)
+      v.push_back(r.nb_digits);
+    return v;
+  };
+  // the digit counts are completed in the descending order: only the smallest record holders are logged
+  RecordLog log;
+  log.start(2, 6);
+  log.add(6, 5, "222226");
+  log.add(5, 5, "22225");
+  log.add(4, 3, "2224");
+  CHECK(log.records().empty());
+  log.add(3, 4, "223");
+  CHECK(log.records().empty());
+  log.add(2, 2, "22");
+  CHECK(nb_digits_of(log.records()) == std::vector<int>{ 2, 3, 5 });
+  CHECK(log.records().back().record_holder == "22225");
+  // outside of the search
+  log.add(7, 6, "2222227");
+  CHECK(nb_digits_of(log.records()) == std::vector<int>{ 2, 3, 5, 7 });
+}
+
+TEST_CASE("Checkpoint")
+{
+  std::string filename = "persistence_checkpoint_test.csv";
+  ChunkResult r;
+  r.nb_candidates = 12;
+  r.max_persistence = 11;
+  r.cpu_time = 0.25;
+  r.record_holder.nb_2 = 1; r.record_holder.nb_7 = 6; r.record_holder.nb_8 = 6; r.record_holder.nb_9 = 2;
+  r.distribution.nb_candidates[2][0] = 10;
+  r.distribution.nb_candidates[3][8] = 1;
+  r.distribution.nb_candidates[11][0] = 1;
+  {
+    Checkpoint checkpoint(filename, 50);
+    checkpoint.open(false);
+    checkpoint.add_chunk_result(15, 3, r, 0.5);
+    checkpoint.add_chunk_result(15, 4, r, 0.75);
+    checkpoint.add_nb_digits_done(15, 1.5);
+  }
+  {
+    // a line truncated inside the distribution
+    std::ofstream file(filename, std::ios::app);
+    file << "chunk,16,0,12,11,1,0,0,6,6,2,0.25,0.5,2:0:10;3:8";
+  }
+  {
+    Checkpoint checkpoint(filename, 50);
+    CHECK(checkpoint.load());
+    const ChunkResult & loaded = checkpoint.previous_chunk_results[15][3];
+    CHECK(loaded.nb_candidates == 12);
+    CHECK(loaded.max_persistence == 11);
+    CHECK(loaded.cpu_time == 0.25);
+    CHECK(loaded.record_holder.primeExponents() == r.record_holder.primeExponents());
+    CHECK(loaded.distribution == r.distribution);
+    CHECK(checkpoint.previous_chunk_results[15].size() == 2);
+    CHECK(checkpoint.previous_chunk_results[16].empty());
+    CHECK(checkpoint.previous_nb_digits_elapsed[15] == 1.5);
+    CHECK(checkpoint.previous_nb_digits_partial_elapsed[15] == 0.75);
+    CHECK(checkpoint.nb_invalid_lines == 1);
+  }
+  {
+    Checkpoint checkpoint(filename, 100);
+    CHECK(!checkpoint.load());
+  }
+  {
+    // a last line cut inside a number, without its newline: it is ignored, and removed before appending
+    {
+      std::ofstream file(filename, std::ios::app);
+      file << "\nnb_digits,17,2.5\nnb_digits,16,1";
+    }
+    Checkpoint checkpoint(filename, 50);
+    CHECK(checkpoint.load());
+    CHECK(checkpoint.previous_nb_digits_elapsed.count(17) == 1);
+    CHECK(checkpoint.previous_nb_digits_elapsed.count(16) == 0);
+    checkpoint.open(true);
+    checkpoint.add_chunk_result(16, 0, r);
+  }
+  {
+    Checkpoint checkpoint(filename, 50);
+    CHECK(checkpoint.load());
+    CHECK(checkpoint.previous_chunk_results[16].size() == 1);
+    CHECK(checkpoint.previous_nb_digits_elapsed.count(16) == 0);
+    CHECK(checkpoint.nb_invalid_lines == 1); // the truncated chunk line, ended by the newline written after it
+  }
+  std::remove(filename.c_str());
+  {
+    // --resume without a checkpoint file: the header is written
+    Shard shard { 1, 3 };
+    Checkpoint checkpoint(filename, 50, shard);
+    CHECK(checkpoint.load());
+    checkpoint.open(true);
+  }
+  {
+    Checkpoint checkpoint(filename, 50);
+    CHECK(checkpoint.load());
+    CHECK(checkpoint.shard == Shard { 1, 3 });
+    CHECK(!Checkpoint(filename, 100).load());
+  }
+  std::remove(filename.c_str());
+  {
+    // a digit count resumed after 100s: its wall time includes them
+    {
+      Checkpoint checkpoint(filename, kNbCandidatesPerChunk);
+      checkpoint.open(false);
+      checkpoint.add_chunk_result(60, 0, process_chunk(CandidateChunks(60, kNbCandidatesPerChunk)[0]), 100.);
+    }
+    Checkpoint checkpoint(filename, kNbCandidatesPerChunk);
+    CHECK(checkpoint.load());
+    MetricsSink metrics("", false);
+    std::vector<std::size_t> chunks_to_process;
+    auto task = prepare_nb_digits_task(60, checkpoint, metrics, process_chunk, chunks_to_process);
+    CHECK(task->previous_elapsed == 100.);
+    CHECK(task->elapsed() >= 100.);
+    CHECK(chunks_to_process.size() == task->chunks.size() - 1);
+  }
+  std::remove(filename.c_str());
+}
+
+TEST_CASE("Sharded search and merge")
+{
+  // each chunk belongs to exactly one shard
+  for (int nb_digits = 1; nb_digits < 50; nb_digits++)
+    for (std::size_t chunk_idx = 0; chunk_idx < 20; chunk_idx++)
+    {
+      int nb_owners = 0;
+      for (int index = 0; index < 3; index++)
+        if (Shard{ index, 3 }.contains(nb_digits, chunk_idx))
+          nb_owners++;
+      CHECK(nb_owners == 1);
+    }
+
+  // 3 shards, written as by 3 processes (the shard 2 did not finish nb_digits = 150)
+  std::vector<std::string> filenames;
+  for (int index = 0; index < 3; index++)
+  {
+    Shard shard { index, 3 };
+    filenames.push_back("persistence_shard_test_" + std::to_string(index) + ".csv");
+    Checkpoint checkpoint(filenames.back(), kNbCandidatesPerChunk, shard);
+    checkpoint.open(false);
+    for (int nb_digits: { 20, 60, 150 })
+    {
+      auto chunks = CandidateChunks(nb_digits, kNbCandidatesPerChunk);
+      for (std::size_t chunk_idx = 0; chunk_idx < chunks.size(); chunk_idx++)
+        if (shard.contains(nb_digits, chunk_idx) && !(index == 2 && nb_digits == 150 && chunk_idx > 0))
+          checkpoint.add_chunk_result(nb_digits, chunk_idx, process_chunk(chunks[chunk_idx]));
+    }
+  }
+  {
+    Checkpoint checkpoint(filenames[1], kNbCandidatesPerChunk);
+    CHECK(checkpoint.load());
+    CHECK(checkpoint.shard == Shard{ 1, 3 });
+  }
+
+  auto merged = merge_shard_results(filenames);
+  CHECK(merged.size() == 3);
+  std::ostringstream expected_distribution;
+  expected_distribution << MetricsSink::kDistributionHeader << "\n";
+  for (int nb_digits: { 20, 60 })
+  {
+    std::vector<ChunkResult> chunk_results;
+    for (const auto & chunk: CandidateChunks(nb_digits, kNbCandidatesPerChunk))
+      chunk_results.push_back(process_chunk(chunk));
+    ChunkResult expected = reduce_chunk_results(chunk_results);
+    const MergedNbDigitsResult & m = merged[nb_digits];
+    CHECK(m.complete());
+    CHECK(m.result.nb_candidates == NbCandidatesWithNbDigits(nb_digits));
+    CHECK(m.result.max_persistence == expected.max_persistence);
+    CHECK(DigitCountsToBigInt(m.result.record_holder) == DigitCountsToBigInt(expected.record_holder));
+    CHECK(m.result.distribution == expected.distribution);
+    MetricsSink::write_distribution(expected_distribution, nb_digits, expected.distribution);
+  }
+  CHECK(!merged[150].complete());
+  CHECK(merge_shards(filenames) == 1);
+
+  // the distribution of the complete digit counts
+  std::string distribution_filename = "persistence_distribution_shard_test.csv";
+  CHECK(merge_shards(filenames, distribution_filename) == 1);
+  {
+    std::ifstream file(distribution_filename);
+    std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    CHECK(content == expected_distribution.str());
+  }
+  std::remove(distribution_filename.c_str());
+  CHECK_THROWS(merge_shard_results({ "no_such_shard_file.csv" }));
+
+  // the files of another search are refused
+  CHECK_THROWS(merge_shard_results({ filenames[0], filenames[1], filenames[1] }));
+  std::string other_filename = "persistence_shard_test_other.csv";
+  auto write_other = [&](const std::vector<std::string> & lines) {
+    std::ofstream file(other_filename);
+    for (const auto & line: lines)
+      file << line << "\n";
+  };
+  write_other({ "chunk_size," + std::to_string(kNbCandidatesPerChunk), "shard,2,4" });
+  CHECK_THROWS(merge_shard_results({ filenames[0], filenames[1], other_filename }));
+  write_other({ "chunk_size," + std::to_string(kNbCandidatesPerChunk / 2), "shard,2,3" });
+  CHECK_THROWS(merge_shard_results({ filenames[0], filenames[1], other_filename }));
+  write_other({ "shard,2,3" });
+  CHECK_THROWS(merge_shard_results({ filenames[0], filenames[1], other_filename }));
+  write_other({ "chunk_size," + std::to_string(kNbCandidatesPerChunk), "shard,2,3" });
+  CHECK(merge_shard_results({ filenames[0], filenames[1], other_filename }).size() == 3);
+  {
+    // a chunk of the shard 0 in the file of the shard 2
+    std::ifstream file(filenames[0]);
+    std::string line;
+    while (std::getline(file, line) && line.rfind("chunk,", 0) != 0) {}
+    write_other({ "chunk_size," + std::to_string(kNbCandidatesPerChunk), "shard,2,3", line });
+  }
+  CHECK_THROWS(merge_shard_results({ filenames[1], other_filename }));
+  CHECK(merge_shards({ filenames[0], filenames[1], filenames[1] }) == 1);
+  std::remove(other_filename.c_str());
+
+  for (int index = 0; index < 3; index++)
+    std::remove(("persistence_shard_test_" + std::to_string(index) + ".csv").c_str());
+}
+
+TEST_CASE("Cost model and scheduling")
+{
+  for (int nb_digits: { 1, 2, 30, 1000 })
+  {
+    long nb_candidates = 0;
+    for (const auto & chunk: CandidateChunks(nb_digits, kNbCandidatesPerChunk))
+      nb_candidates += chunk.nb_candidates();
+    CHECK(nb_candidates == NbCandidatesWithNbDigits(nb_digits));
+  }
+
+  std::string filename = "persistence_metrics_test.csv";
+  {
+    // cpu_time / nb_candidates = 2e-7 * nb_digits^0.5
+    MetricsSink metrics(filename, false);
+    for (int nb_digits: { 10, 25, 100, 400 })
+    {
+      ChunkResult r;
+      r.nb_candidates = 1000;
+      r.record_holder.nb_7 = nb_digits;
+      r.cpu_time = 1000 * 2e-7 * std::sqrt((double)nb_digits);
+      metrics.add_nb_digits_result(nb_digits, r, 1.);
+    }
+  }
+  int nb_points = 0;
+  CostModel model = FitCostModel(filename, &nb_points);
+  CHECK(nb_points == 3); // 10 digits is below kCostModelMinDigits
+  CHECK(std::abs(model.b - 0.5) < 1e-6);
+  CHECK(std::abs(model.a - 2e-7) < 1e-12);
+  std::remove(filename.c_str());
+  CHECK(FitCostModel("no_such_metrics.csv", &nb_points).b == CostModel().b);
+
+  // the most expensive digit counts first, each with its most expensive chunks first
+  Checkpoint checkpoint("persistence_schedule_test.csv", kNbCandidatesPerChunk);
+  MetricsSink metrics("", false);
+  SearchProgress progress(model);
+  auto work = prepare_chunks_work(50, 200, checkpoint, metrics, process_chunk, &progress);
+  ScheduleLongestFirst(work, model);
+  CHECK(work.front().chunk().nb_digits == 200);
+  CHECK(work.back().chunk().nb_digits == 50);
+  std::set<int> nb_digits_done;
+  for (std::size_t i = 1; i < work.size(); i++)
+  {
+    int previous_nb_digits = work[i - 1].chunk().nb_digits, nb_digits = work[i].chunk().nb_digits;
+    if (nb_digits == previous_nb_digits)
+      CHECK(model.chunk_cost(work[i - 1].chunk()) >= model.chunk_cost(work[i].chunk()));
+    else
+    {
+      CHECK(nb_digits < previous_nb_digits);
+      nb_digits_done.insert(previous_nb_digits);
+      CHECK(nb_digits_done.count(nb_digits) == 0); // contiguous
+    }
+  }
+  CHECK(progress.eta() == 0.);
+}
+
+TEST_CASE("Pipeline")
+{
+  {
+    BoundedQueue<int> queue(4);
+    int v = 0;
+    CHECK(!queue.try_pop(v));
+    for (int i = 0; i < 4; i++)
+      CHECK(queue.try_push(i));
+    CHECK(!queue.try_push(4));
+    CHECK(queue.size() == 4);
+    CHECK(queue.try_pop(v));
+    CHECK(v == 0);
+    CHECK(queue.try_push(4));
+
+    // push waits for a pop, pop waits for a push, and returns false once closed and empty
+    std::thread consumer([&queue]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      int value;
+      for (int i = 1; i <= 5; i++)
+        CHECK((queue.pop(value) && value == i));
+      CHECK((queue.pop(value) && value == 6)); // pushed after 50ms
+      CHECK((queue.pop(value) && value == 7)); // pushed just before close
+      CHECK(!queue.pop(value));
+    });
+    queue.push(5);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    queue.push(6);
+    queue.push(7);
+    queue.close();
+    consumer.join();
+    CHECK(queue.size() == 0);
+  }
+
+  std::string filename = "persistence_pipeline_test.csv";
+  {
+    Checkpoint checkpoint(filename, kNbCandidatesPerChunk);
+    checkpoint.open(false);
+    MetricsSink metrics("", false);
+    std::vector<ChunkWork> work;
+    for (int nb_digits: { 3, 30, 150 })
+    {
+      auto nb_digits_work = prepare_chunks_work(nb_digits, nb_digits, checkpoint, metrics, process_chunk);
+      work.insert(work.end(), nb_digits_work.begin(), nb_digits_work.end());
+    }
+    PipelineStats stats = run_pipeline(work, 2, 3);
+    CHECK(stats.nb_batches > 0);
+    CHECK(stats.max_queue_depth <= kPipelineQueueCapacity);
+  }
+  Checkpoint checkpoint(filename, kNbCandidatesPerChunk);
+  CHECK(checkpoint.load());
+  for (int nb_digits: { 3, 30, 150 })
+  {
+    auto chunks = CandidateChunks(nb_digits, kNbCandidatesPerChunk);
+    CHECK(checkpoint.previous_chunk_results[nb_digits].size() == chunks.size());
+    CHECK(checkpoint.previous_nb_digits_elapsed.count(nb_digits) == 1);
+    for (std::size_t chunk_idx = 0; chunk_idx < chunks.size(); chunk_idx++)
+    {
+      ChunkResult expected = process_chunk(chunks[chunk_idx]);
+      const ChunkResult & r = checkpoint.previous_chunk_results[nb_digits][chunk_idx];
+      CHECK(r.nb_candidates == expected.nb_candidates);
+      CHECK(r.max_persistence == expected.max_persistence);
+      CHECK(DigitCountsToBigInt(r.record_holder) == DigitCountsToBigInt(expected.record_holder));
+      CHECK(r.distribution == expected.distribution);
+    }
+  }
+  std::remove(filename.c_str());
+}
+
+TEST_CASE("Distribution file of the pool and of the pipeline")
+{
+  // the same search, with the longest first scheduling: the digit counts are completed in any order
+  auto search = [](bool pipeline) {
+    std::string suffix = pipeline ? "pipeline" : "pool";
+    std::string checkpoint_filename = "persistence_checkpoint_" + suffix + "_test.csv";
+    std::string metrics_filename = "persistence_metrics_" + suffix + "_test.csv";
+    std::string distribution_filename = "persistence_distribution_" + suffix + "_test.csv";
+    {
+      Checkpoint checkpoint(checkpoint_filename, kNbCandidatesPerChunk);
+      checkpoint.open(false);
+      MetricsSink metrics(metrics_filename, false, distribution_filename);
+      auto work = prepare_chunks_work(4, 60, checkpoint, metrics, process_chunk);
+      ScheduleLongestFirst(work, CostModel());
+      if (pipeline)
+        run_pipeline(work, 2, 2);
+      else
+      {
+        boost::asio::thread_pool pool(3);
+        post_chunks(pool, work);
+        pool.join();
+      }
+      metrics.finish();
+    }
+    std::ifstream file(distribution_filename);
+    std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    for (const auto & filename: { checkpoint_filename, metrics_filename, distribution_filename })
+      std::remove(filename.c_str());
+    return content;
+  };
+  std::string pool_content = search(false), pipeline_content = search(true);
+  CHECK(pool_content == pipeline_content);
+
+  // sorted by nb_digits, from 4 to 60
+  std::istringstream ss(pool_content);
+  std::string line;
+  std::getline(ss, line);
+  CHECK(line == MetricsSink::kDistributionHeader);
+  int previous_nb_digits = 4;
+  std::set<int> all_nb_digits;
+  while (std::getline(ss, line))
+  {
+    int nb_digits = std::atoi(line.c_str());
+    CHECK(nb_digits >= previous_nb_digits);
+    previous_nb_digits = nb_digits;
+    all_nb_digits.insert(nb_digits);
+  }
+  CHECK(all_nb_digits.size() == 57);
+}
+
+#ifdef PERSISTENCE_TRACE
+TEST_CASE("Trace")
+{
+  auto count = [](const std::string & s, const std::string & pattern) {
+    long n = 0;
+    for (std::size_t pos = s.find(pattern); pos != std::string::npos; pos = s.find(pattern, pos + 1))
+      n++;
+    return n;
+  };
+
+  Trace::Enable();
+  std::string filename = "persistence_trace_test.csv";
+  {
+    Checkpoint checkpoint(filename, kNbCandidatesPerChunk);
+    checkpoint.open(false);
+    MetricsSink metrics("", false);
+    auto work = prepare_chunks_work(60, 60, checkpoint, metrics, process_chunk);
+    boost::asio::thread_pool pool(2);
+    post_chunks(pool, work);
+    pool.join();
+  }
+  std::remove(filename.c_str());
+  // the buffer of a thread keeps its last kBufferSize events
+  std::thread([] {
+    for (std::size_t i = 0; i < Trace::kBufferSize + 10; i++)
+      Trace::Record("overwritten", (long)i, (long)i + 1);
+  }).join();
+  Trace::Enable(false);
+
+  std::ostringstream os;
+  Trace::WriteStats stats = Trace::WriteChromeTrace(os);
+  std::string trace = os.str();
+  CHECK(trace.rfind("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", 0) == 0);
+  CHECK(trace.substr(trace.size() - 3) == "]}\n");
+  CHECK(stats.nb_overwritten == 10);
+  CHECK(count(trace, "\"name\":\"overwritten\"") == (long)Trace::kBufferSize);
+  CHECK(count(trace, "\"name\":\"pool ") >= 1);
+
+  auto chunks = CandidateChunks(60, kNbCandidatesPerChunk);
+  long nb_samples = 0;
+  for (const auto & chunk: chunks)
+    nb_samples += (chunk.nb_candidates() + kTraceSamplePeriod - 1) / kTraceSamplePeriod;
+  CHECK(count(trace, "\"name\":\"chunk\"") == (long)chunks.size());
+  CHECK(count(trace, "\"args\":{\"nb_digits\":60,\"index\":1}") == 1);
+  CHECK(count(trace, "\"name\":\"generate\"") == nb_samples);
+  CHECK(count(trace, "\"name\":\"score\"") == nb_samples);
+  // the digit count is an async span
+  CHECK(count(trace, "\"name\":\"nb_digits\",\"cat\":\"nb_digits\",\"id\":60,\"ph\":\"b\"") == 1);
+  CHECK(count(trace, "\"name\":\"nb_digits\",\"cat\":\"nb_digits\",\"id\":60,\"ph\":\"e\"") == 1);
+}
+#endif
+
+TEST_CASE("parse_options")
+{
+  auto parse = [](std::vector<std::string> args, Options & options) {
+    std::vector<char *> argv { (char *)"persistence" };
+    for (auto & arg: args)
+      argv.push_back(&arg[0]);
+    return parse_options((int)argv.size(), argv.data(), options);
+  };
+  {
+    Options options;
+    CHECK(parse({ "--threads", "3", "--min-digits", "10", "--max-digits", "200", "--resume", "--reverse", "--metrics", "m.csv" }, options));
+    CHECK(options.nb_threads == 3);
+    CHECK(options.nb_digits_min == 10);
+    CHECK(options.nb_digits_max == 200);
+    CHECK(options.resume);
+    CHECK(options.metrics_filename == "m.csv");
+    CHECK(options.reverse);
+  }
+  {
+    Options options;
+    CHECK(parse({ "--trace", "trace.json" }, options) == Trace::kCompiled);
+    CHECK(options.trace_filename == (Trace::kCompiled ? "trace.json" : ""));
+  }
+  for (const auto & args: std::vector<std::vector<std::string>> {
+         { "--min-digits", "20", "--max-digits", "10" },
+         { "--min-digits", "200" }, // above the default --max-digits
+         { "--min-digits", "-1" } })
+  {
+    Options options;
+    CHECK(!parse(args, options));
+  }
+  {
+    Options options;
+    CHECK(parse({ "--min-digits", "10", "--max-digits", "10" }, options));
+  }
+  {
+    Options options;
+    CHECK(parse({}, options));
+    CHECK(options.nb_threads >= 1);
+    CHECK(!options.resume);
+    CHECK(options.memo_cache_mb == 0);
+  }
+  Options options;
+  CHECK(!parse({ "--threads" }, options));
+  CHECK(!parse({ "--threads", "abc" }, options));
+  CHECK(!parse({ "--max-digits", "0" }, options));
+  CHECK(options.nb_digits_max == Options().nb_digits_max); // unchanged by an invalid value
+  CHECK(!parse({ "--unknown" }, options));
+  CHECK(!parse({ "--metrics" }, options));
+  CHECK(parse({ "--memo-cache", "64" }, options));
+  CHECK(options.memo_cache_mb == 64);
+  CHECK(parse({ "--memo-cache", "0" }, options));
+  CHECK(parse({ "--shard", "2/5" }, options));
+  CHECK(options.shard == Shard{ 2, 5 });
+  CHECK(options.checkpoint_filename() == "persistence_shard_2_of_5.csv");
+  CHECK(!parse({ "--shard", "5/5" }, options));
+  CHECK(!parse({ "--shard", "1-5" }, options));
+  CHECK(parse({ "--base", "36" }, options));
+  CHECK(options.base == 36);
+  CHECK(!parse({ "--base", "37" }, options));
+  CHECK(!parse({ "--base", "1" }, options));
+  CHECK(parse({ "--pipeline", "1/3" }, options));
+  CHECK(options.nb_producers == 1);
+  CHECK(options.nb_scorers == 3);
+  CHECK(!parse({ "--pipeline", "0/3" }, options));
+  CHECK(parse({ "--merge", "a.csv", "b.csv" }, options));
+  CHECK(options.merge_filenames == std::vector<std::string>{ "a.csv", "b.csv" });
+  CHECK(options.memo_cache_mb == 0);
 }
 
 TEST_CASE("test some values")
@@ -2,6 +2,14 @@
 #include <vector>
 #include <atomic>
 #include <future>
+#include <string>
+#include <cstdint>
+#include "stopwatch.hpp"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define NAIVE_HAS_AVX2_KERNEL
+#endif
 
 using BigInt = long long;
 
@@ -27,6 +35,191 @@ inline BigInt PersistenceValue(BigInt v)
   return n;
 }
 
+// DigitProductTables : precomputed tables for the naive search
+// * the digit products of all the blocks of kBlockDigits digits (OneTransform is then
+//   one multiplication per block)
+// * the persistence of all the values below kPersistenceTableSize (so that PersistenceValue_Tables
+//   stops as soon as a product falls below it, usually after one transform)
+constexpr int kBlockDigits = 4;
+constexpr BigInt kBlockSize = 10000;
+constexpr BigInt kPersistenceTableSize = 100000000;
+
+struct DigitProductTables
+{
+  std::vector<BigInt> block_products;         // the leading zeros of the block count as digits
+  std::vector<BigInt> leading_block_products; // the leading zeros are not digits
+  std::vector<std::uint8_t> persistences;
+};
+
+DigitProductTables gTables;
+
+// OneTransform_Blocks : OneTransform, by blocks of kBlockDigits digits
+inline BigInt OneTransform_Blocks(BigInt v)
+{
+  BigInt r = 1;
+  while (v >= kBlockSize)
+  {
+    r *= gTables.block_products[v % kBlockSize];
+    if (r == 0)
+      return 0;
+    v /= kBlockSize;
+  }
+  return r * gTables.leading_block_products[v];
+}
+
+inline BigInt PersistenceValue_Tables(BigInt v)
+{
+  BigInt n = 0;
+  while (v >= kPersistenceTableSize)
+  {
+    v = OneTransform_Blocks(v);
+    n++;
+  }
+  return n + gTables.persistences[v];
+}
+
+void BuildDigitProductTables()
+{
+  stopwatch timer;
+  gTables.block_products.resize(kBlockSize);
+  gTables.leading_block_products.resize(kBlockSize);
+  for (BigInt v = 0; v < kBlockSize; v++)
+  {
+    gTables.leading_block_products[v] = OneTransform(v);
+    // with its leading zeros, a block has a zero digit if it is below 10^(kBlockDigits-1)
+    gTables.block_products[v] = (v < kBlockSize / 10) ? 0 : gTables.leading_block_products[v];
+  }
+
+  // OneTransform(v) < v when v >= 10: the table is filled by increasing values
+  gTables.persistences.resize(kPersistenceTableSize);
+  for (BigInt v = 0; v < kPersistenceTableSize; v++)
+    gTables.persistences[v] = (v < 10) ? 0 : 1 + gTables.persistences[OneTransform_Blocks(v)];
+
+  std::size_t memory = gTables.block_products.size() * sizeof(BigInt) * 2 + gTables.persistences.size();
+  std::cout << "Digit product tables: built in " << timer.elapsed() << "s, "
+            << memory / (1024 * 1024) << "MB\n";
+}
+
+// The values are evaluated by batches of kBatchSize consecutive values
+// (kNbVectors AVX2 registers of 4 doubles, which are processed in an interleaved way)
+constexpr int kNbVectors = 4;
+constexpr int kBatchSize = 4 * kNbVectors;
+
+inline void PersistenceValues_Scalar(BigInt first, BigInt * persistences)
+{
+  for (int i = 0; i < kBatchSize; i++)
+    persistences[i] = PersistenceValue(first + i);
+}
+
+// PersistenceValues_Tables : with the digit product tables.
+// Consecutive values share their high blocks: their product is computed once per batch
+inline void PersistenceValues_Tables(BigInt first, BigInt * persistences)
+{
+  BigInt high = -1, high_product = 0;
+  for (int i = 0; i < kBatchSize; i++)
+  {
+    BigInt v = first + i;
+    if (v < kPersistenceTableSize)
+    {
+      persistences[i] = gTables.persistences[v];
+      continue;
+    }
+    if (v / kBlockSize != high)
+    {
+      high = v / kBlockSize;
+      high_product = OneTransform_Blocks(high);
+    }
+    persistences[i] = 1 + PersistenceValue_Tables(high_product * gTables.block_products[v % kBlockSize]);
+  }
+}
+
+#ifdef NAIVE_HAS_AVX2_KERNEL
+// The AVX2 kernel computes with doubles: it is exact below 2^53
+// (the digit products of such values are also below 2^53)
+constexpr BigInt kMaxExactDouble = 1LL << 53;
+
+// PersistenceValues_AVX2 : each lane extracts one digit per iteration, with
+// a multiplication by 0.1. Below 2^53, floor(x * 0.1) is x / 10 or x / 10 + 1: the product
+// is never below x / 10 (the double 0.1 is slightly above 1/10), but above 2^49 its rounding
+// may reach the next integer when x ends with 9 (for example 7777777777777779).
+// The quotient is then corrected from the sign of the extracted digit.
+// A transform stops at the last digit or at the first zero digit; the lane then starts
+// the next transform, or stops if the product is a single digit.
+__attribute__((target("avx2")))
+void PersistenceValues_AVX2(BigInt first, BigInt * persistences)
+{
+  const __m256d zero = _mm256_setzero_pd();
+  const __m256d one = _mm256_set1_pd(1.);
+  const __m256d ten = _mm256_set1_pd(10.);
+  const __m256d tenth = _mm256_set1_pd(0.1);
+
+  __m256d current[kNbVectors], product[kNbVectors], counts[kNbVectors], running[kNbVectors];
+  for (int k = 0; k < kNbVectors; k++)
+  {
+    double f = (double)(first + 4 * k);
+    current[k] = _mm256_setr_pd(f, f + 1., f + 2., f + 3.);
+    product[k] = one;
+    counts[k] = zero;
+    running[k] = _mm256_cmp_pd(current[k], ten, _CMP_GE_OQ);
+  }
+
+  bool any_running = true;
+  while (any_running)
+  {
+    any_running = false;
+    for (int k = 0; k < kNbVectors; k++)
+    {
+      __m256d quotient = _mm256_floor_pd(_mm256_mul_pd(current[k], tenth));
+      __m256d digit = _mm256_sub_pd(current[k], _mm256_mul_pd(quotient, ten));
+      __m256d rounded_up = _mm256_cmp_pd(digit, zero, _CMP_LT_OQ);
+      quotient = _mm256_sub_pd(quotient, _mm256_and_pd(rounded_up, one));
+      digit = _mm256_add_pd(digit, _mm256_and_pd(rounded_up, ten));
+      product[k] = _mm256_mul_pd(product[k], digit);
+      current[k] = quotient;
+
+      __m256d transform_done = _mm256_and_pd(running[k], _mm256_or_pd(
+        _mm256_cmp_pd(current[k], zero, _CMP_EQ_OQ),
+        _mm256_cmp_pd(product[k], zero, _CMP_EQ_OQ)));
+      counts[k] = _mm256_add_pd(counts[k], _mm256_and_pd(transform_done, one));
+      __m256d next_transform = _mm256_and_pd(transform_done, _mm256_cmp_pd(product[k], ten, _CMP_GE_OQ));
+      running[k] = _mm256_andnot_pd(_mm256_andnot_pd(next_transform, transform_done), running[k]);
+      current[k] = _mm256_blendv_pd(current[k], product[k], next_transform);
+      product[k] = _mm256_blendv_pd(product[k], one, next_transform);
+
+      any_running |= (_mm256_movemask_pd(running[k]) != 0);
+    }
+  }
+
+  for (int k = 0; k < kNbVectors; k++)
+  {
+    double counts_array[4];
+    _mm256_storeu_pd(counts_array, counts[k]);
+    for (int i = 0; i < 4; i++)
+      persistences[4 * k + i] = (BigInt)counts_array[i];
+  }
+}
+#endif // #ifdef NAIVE_HAS_AVX2_KERNEL
+
+// PersistenceValues : persistences of first, first + 1, ..., first + kBatchSize - 1
+// (with the tables once they are built, or else with the AVX2 kernel if the cpu supports it)
+inline void PersistenceValues(BigInt first, BigInt * persistences)
+{
+  if (!gTables.persistences.empty())
+  {
+    PersistenceValues_Tables(first, persistences);
+    return;
+  }
+#ifdef NAIVE_HAS_AVX2_KERNEL
+  static const bool has_avx2 = __builtin_cpu_supports("avx2");
+  if (has_avx2 && first >= 0 && first + kBatchSize <= kMaxExactDouble)
+  {
+    PersistenceValues_AVX2(first, persistences);
+    return;
+  }
+#endif
+  PersistenceValues_Scalar(first, persistences);
+}
+
 void LogProgress(BigInt start, BigInt end, BigInt i)
 {
   if (i % 100000000 == 0)
@@ -40,26 +233,88 @@ BigInt currentMax;
 
 void search(BigInt start, BigInt end, int thread_id)
 {
-  for (BigInt i = start; i < end; i++)
+  BigInt persistences[kBatchSize];
+  for (BigInt batch_start = start; batch_start < end; batch_start += kBatchSize)
   {
-    if (thread_id == 0)
-      LogProgress(start, end, i);
-    BigInt r = PersistenceValue(i);
-    if (r > currentMax)
+    PersistenceValues(batch_start, persistences);
+    for (BigInt i = batch_start; i < batch_start + kBatchSize && i < end; i++)
     {
-      currentMax = r;
-      std::cout
-        << "New max at i=" << i
-        << " => " << currentMax
-        << " (thread " << thread_id << ")" << "\n";
+      if (thread_id == 0)
+        LogProgress(start, end, i);
+      BigInt r = persistences[i - batch_start];
+      if (r > currentMax)
+      {
+        currentMax = r;
+        std::cout
+          << "New max at i=" << i
+          << " => " << currentMax
+          << " (thread " << thread_id << ")" << "\n";
+      }
     }
   }
 }
 
-int main()
+// kCheckedBatches : the first values of batches which are also compared with the scalar loop:
+// floor(x * 0.1) is rounded up to the next integer in double for the values ending with 9
+// above 2^49 (the last one is the last batch accepted by the AVX2 kernel)
+const BigInt kCheckedBatches[] = {
+  7777777777777779, 8888888888888889, 7999999999999999, 6999999999999990, (1LL << 53) - kBatchSize
+};
+
+// BenchPersistenceValues : compares the scalar loop, the AVX2 kernel and the tables
+// (run with "persistence_naive --bench")
+int BenchPersistenceValues(BigInt start, BigInt nb_values)
+{
+  BigInt nb_values_in_batches = nb_values / kBatchSize * kBatchSize;
+  std::vector<BigInt> scalar_results(nb_values_in_batches);
+
+  stopwatch scalar_timer;
+  for (BigInt i = 0; i < nb_values_in_batches; i++)
+    scalar_results[i] = PersistenceValue(start + i);
+  double scalar_time = scalar_timer.elapsed();
+  std::cout << "scalar: " << scalar_time * 1e9 / nb_values_in_batches << " ns/value\n";
+
+  bool same_results = true;
+  auto bench_batches = [&](const char * name, void (*persistence_values)(BigInt, BigInt *)) {
+    std::vector<BigInt> batch_results(nb_values_in_batches);
+    stopwatch timer;
+    for (BigInt i = 0; i < nb_values_in_batches; i += kBatchSize)
+      persistence_values(start + i, &batch_results[i]);
+    double time = timer.elapsed();
+    bool same = (batch_results == scalar_results);
+    for (BigInt checked_start: kCheckedBatches)
+    {
+      BigInt persistences[kBatchSize];
+      persistence_values(checked_start, persistences);
+      for (BigInt i = 0; i < kBatchSize; i++)
+        if (persistences[i] != PersistenceValue(checked_start + i))
+        {
+          std::cout << name << ": wrong persistence for " << checked_start + i << "\n";
+          same = false;
+        }
+    }
+    same_results = same_results && same;
+    std::cout << name << ": " << time * 1e9 / nb_values_in_batches << " ns/value"
+      << ", speedup: " << scalar_time / time
+      << ", same results: " << (same ? "yes" : "NO") << "\n";
+  };
+
+#ifdef NAIVE_HAS_AVX2_KERNEL
+  if (__builtin_cpu_supports("avx2"))
+    bench_batches("avx2", PersistenceValues_AVX2);
+#endif
+  BuildDigitProductTables();
+  bench_batches("tables", PersistenceValues_Tables);
+  return same_results ? 0 : 1;
+}
+
+int main(int argc, char ** argv)
 {
   currentMax = 0;
   BigInt start = 277777788888899 - 10;
+  if (argc > 1 && std::string(argv[1]) == "--bench")
+    return BenchPersistenceValues(start, 10000000);
+  BuildDigitProductTables();
   //BigInt end = 100000000000;
   BigInt end = start * 2;
   int nb_threads = 8;
@@ -1,4 +1,5 @@
 #include <chrono>
+#include <ctime>
 
 class stopwatch
 {
@@ -12,3 +13,17 @@ private:
     typedef std::chrono::duration<double, std::ratio<1>> second;
     std::chrono::time_point<clock> beg_;
 };
+
+// thread_cpu_stopwatch : CPU time used by the current thread
+class thread_cpu_stopwatch
+{
+public:
+    inline thread_cpu_stopwatch() : beg_(now()) {}
+    inline double elapsed() const { return now() - beg_; }
+private:
+    static double now() {
+        timespec t;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+        return t.tv_sec + t.tv_nsec * 1e-9; }
+    double beg_;
+};